@@ -0,0 +1,47 @@
+; allocator stress benchmark: 2M iterations of malloc/free churn over 8192
+; slots kept on the stack. a pseudo-random slot is freed when it holds a
+; block and otherwise gets a new block of 8..1600 bytes. the program writes
+; and returns a checksum of every address malloc returned, so any change in
+; address assignment shows up in the output.
+;
+;   ./swpp-interpreter --engine=bytecode bench/alloc_churn.s
+start main 0:
+.entry:
+  r1 = add 0 0 64
+  r2 = add 7 0 64
+  r3 = add 0 0 64
+  br .loop
+.loop:
+  r4 = icmp eq r1 2000000 64
+  br r4 .exit .body
+.body:
+  r2 = mul r2 1103515245 64
+  r2 = add r2 12345 64
+  r2 = and r2 4294967295 64
+  r5 = lshr r2 8 64
+  r6 = urem r5 8192 64
+  r6 = mul r6 8 64
+  r7 = load 8 r6
+  r8 = icmp eq r7 0 64
+  br r8 .alloc .free
+.alloc:
+  r9 = lshr r2 20 64
+  r9 = urem r9 200 64
+  r9 = incr r9 64
+  r9 = mul r9 8 64
+  r10 = malloc r9
+  store 8 r10 r6
+  r11 = mul r3 31 64
+  r3 = add r11 r10 64
+  br .next
+.free:
+  free r7
+  store 8 0 r6
+  br .next
+.next:
+  r1 = incr r1 64
+  br .loop
+.exit:
+  call write r3
+  ret r3
+end main
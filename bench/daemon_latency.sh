@@ -0,0 +1,31 @@
+#!/bin/bash
+# latency of small jobs: cold invocations against the same jobs sent to a
+# running server. prints the mean microseconds per job of each.
+#
+#   bench/daemon_latency.sh <build directory> <program.s> [input file] [runs]
+BIN=$(readlink -f "$1/swpp-interpreter")
+CLIENT=$(readlink -f "$1/swpp-client")
+PROG=$(readlink -f "$2")
+INPUT=${3:-/dev/null}
+RUNS=${4:-200}
+SOCK=$(mktemp -u /tmp/swpp-bench.XXXXXX)
+WORK=$(mktemp -d)
+cd "$WORK" || exit 1
+
+"$BIN" --serve="$SOCK" &
+SERVER=$!
+trap 'kill $SERVER; rm -rf "$SOCK" "$WORK"' EXIT
+while [ ! -S "$SOCK" ]; do sleep 0.01; done
+
+mean_us() {
+  local start end
+  start=$(date +%s%N)
+  for ((i = 0; i < RUNS; i++)); do
+    "$@" < "$INPUT" > /dev/null
+  done
+  end=$(date +%s%N)
+  echo $(( (end - start) / RUNS / 1000 ))
+}
+
+echo "cold:   $(mean_us "$BIN" "$PROG") us/job"
+echo "server: $(mean_us "$CLIENT" --socket="$SOCK" "$PROG") us/job"
@@ -0,0 +1,60 @@
+// memory the parsed IR of a program takes, per instruction, and the time to
+// parse and to release it. heap use is read from malloc before and after.
+//
+//   build/swpp-ir-memory <program.s>
+
+#include <chrono>
+#include <iostream>
+#include <malloc.h>
+
+#include "parser.h"
+
+using namespace std;
+
+static size_t heap_in_use() {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+static double ms_since(chrono::steady_clock::time_point start) {
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    cerr << "usage: " << argv[0] << " <program.s>" << endl;
+    return 1;
+  }
+
+  size_t before = heap_in_use();
+  auto start = chrono::steady_clock::now();
+  Program* program;
+  Status status = parse(argv[1], program);
+  double parse_ms = ms_since(start);
+  if (!status.ok()) {
+    cerr << status.to_string() << endl;
+    return 1;
+  }
+  size_t heap = heap_in_use() - before;
+
+  size_t nfunctions = program->get_functions().size(), nbbs = 0, nstmts = 0;
+  for (auto function: program->get_functions()) {
+    for (auto& it: function->get_bbs()) {
+      nbbs++;
+      for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next())
+        nstmts++;
+    }
+  }
+
+  start = chrono::steady_clock::now();
+  size_t arena = program->get_size();
+  delete program;
+  double release_ms = ms_since(start);
+
+  cout << nfunctions << " functions, " << nbbs << " blocks, " << nstmts << " instructions" << endl;
+  cout << "heap:    " << heap << " bytes, " << (double)heap / nstmts << " per instruction" << endl;
+  cout << "arena:   " << arena << " bytes, " << (double)arena / nstmts << " per instruction" << endl;
+  cout << "parse:   " << parse_ms << " ms" << endl;
+  cout << "release: " << release_ms << " ms" << endl;
+  return 0;
+}
@@ -0,0 +1,62 @@
+#!/bin/bash
+# time per instruction of each family of arithmetic instructions, on both
+# engines. every program runs a loop whose body is 16 instructions of one
+# family, mixing widths and register/constant operands. prints the
+# nanoseconds per executed instruction of the fastest of a few runs.
+#
+#   bench/kernels.sh <build directory> [iterations] [runs]
+BIN=$(readlink -f "$1/swpp-interpreter")
+ITERS=${2:-1000000}
+RUNS=${3:-5}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+# family name, then the 16 instructions of the loop body
+FAMILIES=(
+  "addsub|r1 = add r1 r2 64|r2 = sub r2 3 32|r3 = add r3 5 32|r4 = sub r4 r1 64|r1 = add r1 7 16|r2 = add r2 r3 64|r3 = sub r3 1 8|r4 = add r4 9 64|r1 = sub r1 r4 32|r2 = add r2 11 64|r3 = add r3 r2 32|r4 = sub r4 13 16|r1 = add r1 15 64|r2 = sub r2 r1 64|r3 = add r3 17 32|r4 = add r4 r3 8"
+  "muldiv|r1 = mul r1 r2 64|r2 = udiv r2 3 32|r3 = mul r3 5 32|r4 = urem r4 r5 64|r1 = sdiv r1 7 16|r2 = mul r2 r3 64|r3 = srem r3 9 8|r4 = mul r4 9 64|r1 = udiv r1 r5 32|r2 = mul r2 11 64|r3 = urem r3 r5 32|r4 = sdiv r4 13 16|r1 = mul r1 15 64|r2 = srem r2 r5 64|r3 = mul r3 17 32|r4 = udiv r4 r5 8"
+  "logical|r1 = and r1 r2 64|r2 = or r2 3 32|r3 = xor r3 5 32|r4 = shl r4 r5 64|r1 = lshr r1 7 16|r2 = ashr r2 r5 64|r3 = and r3 255 8|r4 = or r4 9 64|r1 = xor r1 r4 32|r2 = shl r2 11 64|r3 = lshr r3 r5 32|r4 = ashr r4 13 16|r1 = or r1 15 64|r2 = and r2 r1 64|r3 = xor r3 17 32|r4 = shl r4 r3 8"
+  "icmp|r1 = icmp eq r1 r2 64|r2 = icmp ne r2 3 32|r3 = icmp ugt r3 5 32|r4 = icmp uge r4 r5 64|r1 = icmp ult r1 7 16|r2 = icmp ule r2 r3 64|r3 = icmp sgt r3 9 8|r4 = icmp sge r4 9 64|r1 = icmp slt r1 r4 32|r2 = icmp sle r2 11 64|r3 = icmp eq r3 r2 32|r4 = icmp ne r4 13 16|r1 = icmp ugt r1 15 64|r2 = icmp slt r2 r1 64|r3 = icmp ult r3 17 32|r4 = icmp sge r4 r3 8"
+  "uop|r1 = incr r1 64|r2 = decr r2 32|r3 = incr r3 16|r4 = decr r4 8|r1 = incr r1 32|r2 = incr r2 64|r3 = decr r3 64|r4 = incr r4 32|r1 = decr r1 16|r2 = incr r2 8|r3 = incr r3 32|r4 = decr r4 64|r1 = incr r1 64|r2 = decr r2 16|r3 = incr r3 8|r4 = incr r4 32"
+)
+
+for family in "${FAMILIES[@]}"; do
+  IFS='|' read -r -a insts <<< "$family"
+  {
+    echo "start main 0:"
+    echo ".entry:"
+    echo "  r1 = add 1 0 64"
+    echo "  r2 = add 2 0 64"
+    echo "  r3 = add 3 0 64"
+    echo "  r4 = add 4 0 64"
+    echo "  r5 = add 5 0 64"
+    echo "  r6 = add $ITERS 0 64"
+    echo "  br .loop"
+    echo ".loop:"
+    for inst in "${insts[@]:1}"; do
+      echo "  $inst"
+    done
+    echo "  r6 = decr r6 64"
+    echo "  r7 = icmp ne r6 0 64"
+    echo "  br r7 .loop .exit"
+    echo ".exit:"
+    echo "  ret r1"
+    echo "end main"
+  } > "${insts[0]}.s"
+
+  for engine in tree bytecode; do
+    best=
+    for ((run = 0; run < RUNS; run++)); do
+      start=$(date +%s%N)
+      "$BIN" --engine=$engine "${insts[0]}.s" > /dev/null
+      end=$(date +%s%N)
+      if [ -z "$best" ] || [ $((end - start)) -lt "$best" ]; then
+        best=$((end - start))
+      fi
+    done
+    # 16 instructions of the family, and 3 of loop control
+    awk -v f="${insts[0]}" -v e=$engine -v ns=$best -v n=$((ITERS * 19)) \
+      'BEGIN { printf "%-8s %-8s %6.2f ns/inst\n", f, e, ns / n }'
+  done
+done
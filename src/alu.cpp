@@ -0,0 +1,34 @@
+#include "alu.h"
+
+
+#define SIZE_KERNELS(KERNEL, K) \
+  { KERNEL<K, Size1>, KERNEL<K, Size8>, KERNEL<K, Size16>, KERNEL<K, Size32>, KERNEL<K, Size64> }
+
+/** indexed by BopKind, then Size */
+static const BopKernel bop_kernels[][5] = {
+  SIZE_KERNELS(bop_kernel, Udiv), SIZE_KERNELS(bop_kernel, Sdiv),
+  SIZE_KERNELS(bop_kernel, Urem), SIZE_KERNELS(bop_kernel, Srem),
+  SIZE_KERNELS(bop_kernel, Mul),
+  SIZE_KERNELS(bop_kernel, Shl), SIZE_KERNELS(bop_kernel, Lshr),
+  SIZE_KERNELS(bop_kernel, Ashr), SIZE_KERNELS(bop_kernel, And),
+  SIZE_KERNELS(bop_kernel, Or), SIZE_KERNELS(bop_kernel, Xor),
+  SIZE_KERNELS(bop_kernel, Add), SIZE_KERNELS(bop_kernel, Sub),
+  SIZE_KERNELS(bop_kernel, Eq), SIZE_KERNELS(bop_kernel, Ne),
+  SIZE_KERNELS(bop_kernel, Ugt), SIZE_KERNELS(bop_kernel, Uge),
+  SIZE_KERNELS(bop_kernel, Ult), SIZE_KERNELS(bop_kernel, Ule),
+  SIZE_KERNELS(bop_kernel, Sgt), SIZE_KERNELS(bop_kernel, Sge),
+  SIZE_KERNELS(bop_kernel, Slt), SIZE_KERNELS(bop_kernel, Sle),
+};
+
+/** indexed by UopKind, then Size */
+static const UopKernel uop_kernels[][5] = {
+  SIZE_KERNELS(uop_kernel, Incr), SIZE_KERNELS(uop_kernel, Decr),
+};
+
+BopKernel get_bop_kernel(BopKind bop_kind, Size size) {
+  return bop_kernels[bop_kind][size];
+}
+
+UopKernel get_uop_kernel(UopKind uop_kind, Size size) {
+  return uop_kernels[uop_kind][size];
+}
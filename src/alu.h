@@ -0,0 +1,306 @@
+#ifndef SWPP_ASM_INTERPRETER_ALU_H
+#define SWPP_ASM_INTERPRETER_ALU_H
+
+#include <cinttypes>
+
+#include "opcode.h"
+#include "size.h"
+#include "error.h"
+
+
+/** semantics of binary operations, shared by the statement and bytecode engines */
+
+inline bool is_signed_op(BopKind bop_kind) {
+  switch(bop_kind) {
+    case Udiv:
+    case Urem:
+    case Mul:
+    case Shl:
+    case Lshr:
+    case And:
+    case Or:
+    case Xor:
+    case Add:
+    case Sub:
+    case Eq:
+    case Ne:
+    case Ugt:
+    case Uge:
+    case Ult:
+    case Ule:
+      return false;
+    case Ashr:
+    case Sdiv:
+    case Srem:
+    case Sgt:
+    case Sge:
+    case Slt:
+    case Sle:
+      return true;
+  }
+  __builtin_unreachable();
+}
+
+inline bool is_shift_op(BopKind bop_kind) {
+  switch(bop_kind) {
+    case Shl:
+    case Lshr:
+    case Ashr:
+      return true;
+    default:
+      return false;
+  }
+}
+
+inline uint64_t get_op1(BopKind bop_kind, Size size, uint64_t val) {
+  if (is_signed_op(bop_kind)) {
+    switch (size) {
+      case Size1:
+        if (val % 2 == 1)
+          return -1;
+        else
+          return 0;
+      case Size8:
+        return (int8_t)val;
+      case Size16:
+        return (int16_t)val;
+      case Size32:
+        return (int32_t)val;
+      case Size64:
+        return val;
+    }
+  }
+  else {
+    switch (size) {
+      case Size1:
+        if (val % 2 == 1)
+          return 1;
+        else
+          return 0;
+      case Size8:
+        return (uint8_t)val;
+      case Size16:
+        return (uint16_t)val;
+      case Size32:
+        return (uint32_t)val;
+      case Size64:
+        return val;
+    }
+  }
+  __builtin_unreachable();
+}
+
+inline uint64_t get_op2(BopKind bop_kind, Size size, uint64_t val) {
+  if (is_shift_op(bop_kind)) {
+    return val % bw_of(size);
+  }
+
+  return get_op1(bop_kind, size, val);
+}
+
+inline uint64_t get_result(Size size, uint64_t val) {
+  switch (size) {
+    case Size1:
+      return val % 2;
+    case Size8:
+      return (uint8_t)val;
+    case Size16:
+      return (uint16_t)val;
+    case Size32:
+      return (uint32_t)val;
+    case Size64:
+      return val;
+  }
+  __builtin_unreachable();
+}
+
+inline uint64_t compute_bop(BopKind bop_kind, Size size, uint64_t op1, uint64_t op2) {
+  op1 = get_op1(bop_kind, size, op1);
+  op2 = get_op2(bop_kind, size, op2);
+  uint64_t result = 0;
+
+  switch (bop_kind) {
+    case Udiv:
+      if (op2 == 0) {
+        invoke_runtime_error("division by zero");
+        return 0;
+      }
+      result = op1 / op2;
+      break;
+    case Sdiv:
+      if (op2 == 0) {
+        invoke_runtime_error("division by zero");
+        return 0;
+      }
+      result = (int64_t) op1 / (int64_t) op2;
+      break;
+    case Urem:
+      if (op2 == 0) {
+        invoke_runtime_error("division by zero");
+        return 0;
+      }
+      result = op1 % op2;
+      break;
+    case Srem:
+      if (op2 == 0) {
+        invoke_runtime_error("division by zero");
+        return 0;
+      }
+      result = (int64_t) op1 % (int64_t) op2;
+      break;
+    case Mul:
+      result = op1 * op2;
+      break;
+    case Shl:
+      result = op1 << op2;
+      break;
+    case Lshr:
+      result = op1 >> op2;
+      break;
+    case Ashr:
+      result = (int64_t) op1 >> op2;
+      break;
+    case And:
+      result = op1 & op2;
+      break;
+    case Or:
+      result = op1 | op2;
+      break;
+    case Xor:
+      result = op1 ^ op2;
+      break;
+    case Add:
+      result = op1 + op2;
+      break;
+    case Sub:
+      result = op1 - op2;
+      break;
+    case Eq:
+      if (op1 == op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Ne:
+      if (op1 != op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Ugt:
+      if (op1 > op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Uge:
+      if (op1 >= op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Ult:
+      if (op1 < op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Ule:
+      if (op1 <= op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Sgt:
+      if ((int64_t) op1 > (int64_t) op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Sge:
+      if ((int64_t) op1 >= (int64_t) op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Slt:
+      if ((int64_t) op1 < (int64_t) op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+    case Sle:
+      if ((int64_t) op1 <= (int64_t) op2)
+        result = 1;
+      else
+        result = 0;
+      break;
+  }
+
+  return get_result(size, result);
+}
+
+inline uint64_t compute_uop(UopKind uop_kind, Size size, uint64_t op) {
+  if (uop_kind == UopKind::Incr)
+    op++;
+  else
+    op--;
+  return get_result(size, op);
+}
+
+/**
+ * compute_bop and compute_uop with the operation and width fixed at compile
+ * time. each folds into a few instructions with no switch left, so a
+ * statement picks its kernel once, when it is made or lowered, and never
+ * looks at its kind or size again.
+ */
+typedef uint64_t (*BopKernel)(uint64_t op1, uint64_t op2);
+typedef uint64_t (*UopKernel)(uint64_t op);
+
+template <BopKind K, Size S>
+uint64_t bop_kernel(uint64_t op1, uint64_t op2) {
+  return compute_bop(K, S, op1, op2);
+}
+
+template <UopKind K, Size S>
+uint64_t uop_kernel(uint64_t op) {
+  return compute_uop(K, S, op);
+}
+
+BopKernel get_bop_kernel(BopKind bop_kind, Size size);
+UopKernel get_uop_kernel(UopKind uop_kind, Size size);
+
+inline double cost_of(const Cost& cost, BopKind bop_kind) {
+  switch (bop_kind) {
+    case Udiv:
+    case Sdiv:
+    case Urem:
+    case Srem:
+    case Mul:
+      return cost.MULDIV;
+    case Shl:
+    case Lshr:
+    case Ashr:
+    case And:
+    case Or:
+    case Xor:
+      return cost.LOGICAL;
+    case Add:
+    case Sub:
+      return cost.ADDSUB;
+    case Eq:
+    case Ne:
+    case Ugt:
+    case Uge:
+    case Ult:
+    case Ule:
+    case Sgt:
+    case Sge:
+    case Slt:
+    case Sle:
+      return cost.COMP;
+  }
+  __builtin_unreachable();
+}
+
+#endif //SWPP_ASM_INTERPRETER_ALU_H
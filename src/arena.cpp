@@ -0,0 +1,65 @@
+#include <cstdint>
+
+#include "arena.h"
+
+
+Arena::Arena(): blocks(), finalizers(), curr(nullptr), end(nullptr), size(0) {}
+
+Arena::~Arena() {
+  for (auto& it: finalizers)
+    it.destroy(it.object);
+  for (char* block: blocks)
+    delete[] block;
+}
+
+/** a request too big for a block gets one of its own, leaving the current block in use */
+void* Arena::allocate(size_t bytes, size_t align) {
+  uintptr_t p = ((uintptr_t)curr + align - 1) & ~(uintptr_t)(align - 1);
+  if (curr != nullptr && p + bytes <= (uintptr_t)end) {
+    curr = (char*)(p + bytes);
+    return (void*)p;
+  }
+
+  // new[] memory is aligned for any fundamental type
+  if (bytes > ARENA_BLOCK_SIZE / 4) {
+    char* block = new char[bytes];
+    blocks.push_back(block);
+    size += bytes;
+    return block;
+  }
+  char* block = new char[ARENA_BLOCK_SIZE];
+  blocks.push_back(block);
+  size += ARENA_BLOCK_SIZE;
+  curr = block + bytes;
+  end = block + ARENA_BLOCK_SIZE;
+  return block;
+}
+
+/** takes over the memory and objects of other, which is left empty */
+void Arena::absorb(Arena& other) {
+  blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end());
+  finalizers.insert(finalizers.end(), other.finalizers.begin(), other.finalizers.end());
+  size += other.size;
+  other.blocks.clear();
+  other.finalizers.clear();
+  other.curr = other.end = nullptr;
+  other.size = 0;
+}
+
+/** bytes taken from the heap */
+size_t Arena::get_size() const { return size; }
+
+
+SymbolTable::SymbolTable(Arena& _arena): arena(_arena), symbols() {}
+
+string_view SymbolTable::intern(string_view name) {
+  auto it = symbols.find(name);
+  if (it != symbols.end())
+    return *it;
+  char* chars = arena.make_array<char>(name.size() + 1);
+  name.copy(chars, name.size());
+  chars[name.size()] = '\0';
+  string_view symbol(chars, name.size());
+  symbols.insert(symbol);
+  return symbol;
+}
@@ -0,0 +1,119 @@
+#ifndef SWPP_ASM_INTERPRETER_ARENA_H
+#define SWPP_ASM_INTERPRETER_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/** memory an arena takes from the heap at a time */
+#define ARENA_BLOCK_SIZE ((size_t)1 << 16)
+
+
+/**
+ * memory for objects that all live as long as their owner, e.g. the IR of
+ * a program. objects are placed one after the other and freed all at once
+ * with the arena; only those that own memory of their own are destroyed.
+ */
+class Arena {
+private:
+  struct Finalizer {
+    void* object;
+    void (*destroy)(void*);
+  };
+
+  vector<char*> blocks;
+  vector<Finalizer> finalizers;
+  char* curr;
+  char* end;
+  size_t size;
+
+public:
+  Arena();
+  ~Arena();
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t bytes, size_t align);
+  void absorb(Arena& other);
+  size_t get_size() const;
+
+  template <typename T, typename... Args>
+  T* make(Args&&... args) {
+    T* object = new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+    if (!is_trivially_destructible<T>::value)
+      finalizers.push_back(Finalizer { object, [](void* p) { static_cast<T*>(p)->~T(); } });
+    return object;
+  }
+
+  /** room for n objects, to be constructed by the caller; T must not need destroying */
+  template <typename T>
+  T* make_array(size_t n) {
+    static_assert(is_trivially_destructible<T>::value, "arena arrays are never destroyed");
+    return static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+  }
+};
+
+
+/** n objects placed in an arena; a view that does not own them */
+template <typename T>
+class ArenaArray {
+private:
+  T* items;
+  size_t n;
+
+public:
+  ArenaArray(): items(nullptr), n(0) {}
+  ArenaArray(T* _items, size_t _n): items(_items), n(_n) {}
+
+  /** a copy of the objects in [first, last) placed in arena */
+  template <typename It>
+  static ArenaArray copy(Arena& arena, It first, It last) {
+    size_t n = last - first;
+    T* items = arena.make_array<T>(n);
+    for (size_t i = 0; i < n; i++)
+      new (items + i) T(*first++);
+    return ArenaArray(items, n);
+  }
+
+  size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+  T* begin() const { return items; }
+  T* end() const { return items + n; }
+  T& operator[](size_t i) const { return items[i]; }
+};
+
+
+/**
+ * the names of a program, each kept once in its arena. interning the same
+ * name twice gives the same characters, so interned names can be told
+ * apart by their address alone (see SymbolHash and SymbolEqual).
+ */
+class SymbolTable {
+private:
+  Arena& arena;
+  unordered_set<string_view> symbols;
+
+public:
+  explicit SymbolTable(Arena& _arena);
+  SymbolTable(const SymbolTable&) = delete;
+  SymbolTable& operator=(const SymbolTable&) = delete;
+
+  string_view intern(string_view name);
+};
+
+/** for containers keyed by names interned in the same table */
+struct SymbolHash {
+  size_t operator()(string_view symbol) const { return hash<const char*>()(symbol.data()); }
+};
+
+struct SymbolEqual {
+  bool operator()(string_view a, string_view b) const { return a.data() == b.data(); }
+};
+
+#endif //SWPP_ASM_INTERPRETER_ARENA_H
@@ -0,0 +1,240 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "report.h"
+
+
+/** one input of a batch, and how running the program on it went */
+struct BatchRun {
+  string name;
+  string path;
+  uint64_t size;
+  double expected_ms;
+  Status status;
+  uint64_t ret;
+  double exec_cost;
+  uint64_t max_heap_size;
+  double ms;
+};
+
+/**
+ * the runs handed to one worker, longest expected first. the worker takes
+ * from the front; a worker that ran out steals from the back of the
+ * others, i.e. the shortest runs left, so that everyone finishes together.
+ */
+class RunQueue {
+private:
+  mutex lock;
+  deque<size_t> runs;
+
+public:
+  void push(size_t run) {
+    lock_guard<mutex> guard(lock);
+    runs.push_back(run);
+  }
+
+  bool pop(size_t& run) {
+    lock_guard<mutex> guard(lock);
+    if (runs.empty())
+      return false;
+    run = runs.front();
+    runs.pop_front();
+    return true;
+  }
+
+  bool steal(size_t& run) {
+    lock_guard<mutex> guard(lock);
+    if (runs.empty())
+      return false;
+    run = runs.back();
+    runs.pop_back();
+    return true;
+  }
+};
+
+/** the regular files in dir, by name */
+static vector<BatchRun> list_inputs(const string& dir) {
+  vector<BatchRun> runs;
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr)
+    return runs;
+
+  while (struct dirent* entry = readdir(d)) {
+    string name = entry->d_name;
+    if (name.empty() || name[0] == '.')
+      continue;
+    string path = dir + "/" + name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+      continue;
+    runs.push_back(BatchRun { name, path, (uint64_t)st.st_size, -1.0, Status(), 0, 0, 0, 0 });
+  }
+  closedir(d);
+
+  sort(runs.begin(), runs.end(), [](const BatchRun& a, const BatchRun& b) { return a.name < b.name; });
+  return runs;
+}
+
+/** the time every input took in the last batch, from its summary */
+static map<string, double> read_durations(const string& summary) {
+  map<string, double> durations;
+  ifstream in(summary);
+  string line;
+  while (getline(in, line)) {
+    vector<string> fields;
+    stringstream ss(line);
+    string field;
+    while (getline(ss, field, '\t'))
+      fields.push_back(field);
+    if (fields.size() != 7)
+      continue;
+    try {
+      durations[fields[0]] = stod(fields[6]);
+    } catch (exception& e) {
+      // the header
+    }
+  }
+  return durations;
+}
+
+static void exec_run(const Program* program, const BatchOptions& options, BatchRun& run) {
+  auto start = chrono::steady_clock::now();
+  string dir = string(BATCH_OUTPUT_DIR) + "/" + run.name + "/";
+  mkdir(dir.c_str(), 0755);
+  // a failing run leaves no logs, as a separate run would not have either
+  unlink((dir + "swpp-interpreter.log").c_str());
+  unlink((dir + "swpp-interpreter-cost.log").c_str());
+  unlink((dir + "swpp-interpreter-inst.log").c_str());
+  unlink((dir + PROFILE_LOG).c_str());
+  unlink((dir + PROFILE_SOURCE).c_str());
+  unlink((dir + PROFILE_EDGES).c_str());
+  unlink((dir + PROFILE_VALUES).c_str());
+
+  FILE* out = fopen((dir + "stdout").c_str(), "w");
+  int in_fd = open(run.path.c_str(), O_RDONLY);
+  if (out == nullptr || in_fd < 0) {
+    run.status = Status(ErrorFile, out == nullptr ? dir + "stdout" : run.path, 0, "");
+  } else {
+    State state(in_fd, out);
+    state.set_program(program);
+    state.set_engine(options.engine);
+    state.set_cost_tree(options.cost_tree);
+    state.set_profile(options.profile);
+    state.set_max_call_depth(options.max_call_depth);
+    run.status = state.exec_program(run.ret);
+    if (run.status.ok()) {
+      run.exec_cost = state.get_cost_value();
+      run.max_heap_size = state.get_max_alloced_size();
+      write_logs(state, run.ret, dir);
+    } else {
+      fprintf(out, "%s\n", run.status.to_string().c_str());
+    }
+  }
+
+  if (out != nullptr)
+    fclose(out);
+  if (in_fd >= 0)
+    close(in_fd);
+  run.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * inputs the last batch did not see go first, largest first, as nothing
+ * is known about them; the rest go by how long they took last time
+ */
+static bool runs_longer(const BatchRun& a, const BatchRun& b) {
+  if ((a.expected_ms < 0) != (b.expected_ms < 0))
+    return a.expected_ms < 0;
+  if (a.expected_ms < 0)
+    return a.size > b.size;
+  return a.expected_ms > b.expected_ms;
+}
+
+int run_batch(const Program* program, const string& input_dir, const BatchOptions& options) {
+  auto start = chrono::steady_clock::now();
+  vector<BatchRun> runs = list_inputs(input_dir);
+  if (runs.empty()) {
+    cout << "Error: no inputs in " << input_dir << endl;
+    return 1;
+  }
+
+  mkdir(BATCH_OUTPUT_DIR, 0755);
+  string summary = string(BATCH_OUTPUT_DIR) + "/" + BATCH_SUMMARY;
+  auto durations = read_durations(summary);
+  for (auto& run: runs) {
+    auto it = durations.find(run.name);
+    if (it != durations.end())
+      run.expected_ms = it->second;
+  }
+
+  vector<size_t> order(runs.size());
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return runs_longer(runs[a], runs[b]); });
+
+  unsigned jobs = options.jobs != 0 ? options.jobs : thread::hardware_concurrency();
+  jobs = max(1u, min(jobs, (unsigned)runs.size()));
+  vector<RunQueue> queues(jobs);
+  for (size_t i = 0; i < order.size(); i++)
+    queues[i % jobs].push(order[i]);
+
+  // no run is queued once the workers start, so a worker with nothing to take or steal is done
+  auto worker = [&](unsigned self) {
+    size_t run;
+    while (true) {
+      bool found = queues[self].pop(run);
+      for (unsigned k = 1; k < jobs && !found; k++)
+        found = queues[(self + k) % jobs].steal(run);
+      if (!found)
+        return;
+      exec_run(program, options, runs[run]);
+    }
+  };
+
+  vector<thread> workers;
+  for (unsigned i = 1; i < jobs; i++)
+    workers.emplace_back(worker, i);
+  worker(0);
+  for (auto& it: workers)
+    it.join();
+
+  stringstream ss;
+  ss << fixed << setprecision(4);
+  ss << "Input\tExit\tReturned\tExecution cost\tMax heap usage (bytes)\tTotal cost\tTime (ms)" << endl;
+  size_t failed = 0;
+  double work_ms = 0;
+  for (auto& run: runs) {
+    work_ms += run.ms;
+    if (!run.status.ok()) {
+      failed++;
+      ss << run.name << "\t1\t-\t-\t-\t-\t" << run.ms << endl;
+      continue;
+    }
+    double max_heap_size = run.max_heap_size;
+    ss << run.name << "\t0\t" << run.ret << "\t" << run.exec_cost << "\t" << max_heap_size << "\t"
+       << run.exec_cost + max_heap_size * 1024.0 << "\t" << run.ms << endl;
+  }
+  double wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  ss << "Total: " << runs.size() << " inputs, " << failed << " failed, " << work_ms << " ms of runs in "
+     << wall_ms << " ms on " << jobs << " threads" << endl;
+
+  ofstream log(summary);
+  log << ss.str();
+  log.close();
+  cout << ss.str();
+  return failed == 0 ? 0 : 1;
+}
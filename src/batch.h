@@ -0,0 +1,32 @@
+#ifndef SWPP_ASM_INTERPRETER_BATCH_H
+#define SWPP_ASM_INTERPRETER_BATCH_H
+
+#include <string>
+
+#include "state.h"
+
+using namespace std;
+
+/** where a batch writes its results, one directory per input plus the summary */
+#define BATCH_OUTPUT_DIR "swpp-interpreter-batch"
+#define BATCH_SUMMARY "summary.log"
+
+
+struct BatchOptions {
+  EngineKind engine;
+  CostTreeKind cost_tree;
+  ProfileKind profile;
+  size_t max_call_depth;
+  unsigned jobs;
+};
+
+/**
+ * runs program once for every file in input_dir, each reading that file as
+ * its input, on options.jobs threads. each input gets a directory in
+ * BATCH_OUTPUT_DIR holding what a separate run would have left: its output
+ * (and error message) in "stdout", and the logs. the summary lists every
+ * run and is also printed. the exit code is 1 if any run failed.
+ */
+int run_batch(const Program* program, const string& input_dir, const BatchOptions& options);
+
+#endif //SWPP_ASM_INTERPRETER_BATCH_H
@@ -0,0 +1,282 @@
+#include "bytecode.h"
+
+
+static void set_operand(Inst& inst, int i, const Value& val) {
+  if (val.is_reg()) {
+    inst.reg[i] = val.get_reg();
+    inst.imm[i] = 0;
+  } else {
+    inst.reg[i] = RegNone;
+    inst.imm[i] = val.get_literal();
+  }
+}
+
+static Operand make_operand(const Value& val) {
+  if (val.is_reg())
+    return Operand { 0, (uint8_t)val.get_reg() };
+  return Operand { val.get_literal(), (uint8_t)RegNone };
+}
+
+/** branch targets are collected as statements and patched once the code array is final */
+struct PendingTargets {
+  vector<pair<const Stmt*, const Stmt*>> branches;
+  vector<const StmtSwitch*> switches;
+  vector<const Function*> callees;
+};
+
+static Inst lower_stmt(const Stmt* stmt, BytecodeFunction& bfunc, PendingTargets& pending) {
+  Inst inst{};
+  inst.line = stmt->get_line();
+  inst.lhs = stmt->get_lhs();
+  for (uint8_t& r: inst.reg)
+    r = RegNone;
+  const Stmt* target1 = nullptr;
+  const Stmt* target2 = nullptr;
+  const Function* callee = nullptr;
+
+  switch (stmt->get_opcode()) {
+    case Ret: {
+      auto s = static_cast<const StmtRet*>(stmt);
+      inst.op = IRet;
+      set_operand(inst, 0, s->get_val());
+      break;
+    }
+    case BrUncond: {
+      auto s = static_cast<const StmtBrUncond*>(stmt);
+      inst.op = IBrUncond;
+      target1 = s->get_bb();
+      break;
+    }
+    case BrCond: {
+      auto s = static_cast<const StmtBrCond*>(stmt);
+      inst.op = IBrCond;
+      set_operand(inst, 0, s->get_cond());
+      target1 = s->get_true_bb();
+      target2 = s->get_false_bb();
+      break;
+    }
+    case Switch: {
+      auto s = static_cast<const StmtSwitch*>(stmt);
+      inst.op = ISwitch;
+      set_operand(inst, 0, s->get_cond());
+      inst.aux = pending.switches.size();
+      pending.switches.push_back(s);
+      break;
+    }
+    case Malloc: {
+      auto s = static_cast<const StmtMalloc*>(stmt);
+      inst.op = IMalloc;
+      set_operand(inst, 0, s->get_val());
+      break;
+    }
+    case Free: {
+      auto s = static_cast<const StmtFree*>(stmt);
+      inst.op = IFree;
+      set_operand(inst, 0, s->get_ptr());
+      break;
+    }
+    case Load: {
+      auto s = static_cast<const StmtLoad*>(stmt);
+      inst.op = ILoad;
+      inst.size = s->get_size();
+      inst.sub = s->get_is_async();
+      set_operand(inst, 0, s->get_ptr());
+      inst.imm[1] = s->get_ofs();
+      break;
+    }
+    case Store: {
+      auto s = static_cast<const StmtStore*>(stmt);
+      inst.op = IStore;
+      inst.size = s->get_size();
+      set_operand(inst, 0, s->get_val());
+      set_operand(inst, 1, s->get_ptr());
+      inst.imm[2] = s->get_ofs();
+      break;
+    }
+    case Bop: {
+      auto s = static_cast<const StmtBop*>(stmt);
+      inst.size = s->get_size();
+      inst.sub = s->get_bop_kind();
+      inst.bop_kernel = get_bop_kernel(s->get_bop_kind(), s->get_size());
+      set_operand(inst, 0, s->get_val1());
+      set_operand(inst, 1, s->get_val2());
+      if (inst.reg[0] == RegNone)
+        inst.op = IBop;
+      else
+        inst.op = inst.reg[1] != RegNone ? IBopRR : IBopRI;
+      break;
+    }
+    case Sum: {
+      auto s = static_cast<const StmtSum*>(stmt);
+      inst.op = ISum;
+      inst.size = s->get_size();
+      inst.aux = bfunc.operands.size();
+      for (auto& val: s->get_values())
+        bfunc.operands.push_back(make_operand(val));
+      break;
+    }
+    case Uop: {
+      auto s = static_cast<const StmtUop*>(stmt);
+      inst.op = IUop;
+      inst.size = s->get_size();
+      inst.sub = s->get_uop_kind();
+      inst.uop_kernel = get_uop_kernel(s->get_uop_kind(), s->get_size());
+      set_operand(inst, 0, s->get_val());
+      break;
+    }
+    case Select: {
+      auto s = static_cast<const StmtSelect*>(stmt);
+      inst.op = ISelect;
+      set_operand(inst, 0, s->get_cond());
+      set_operand(inst, 1, s->get_val_true());
+      set_operand(inst, 2, s->get_val_false());
+      break;
+    }
+    case Call: {
+      auto s = static_cast<const StmtCall*>(stmt);
+      inst.op = ICall;
+      inst.aux = bfunc.operands.size();
+      inst.imm[0] = s->get_args().size();
+      for (auto& val: s->get_args())
+        bfunc.operands.push_back(make_operand(val));
+      callee = s->get_callee();
+      if (callee != nullptr)
+        inst.imm[1] = s->get_saved_regs();
+      inst.imm[2] = s->get_arg_regs();
+      break;
+    }
+    case Assert: {
+      auto s = static_cast<const StmtAssert*>(stmt);
+      inst.op = IAssert;
+      set_operand(inst, 0, s->get_op1());
+      set_operand(inst, 1, s->get_op2());
+      break;
+    }
+    case Read: {
+      inst.op = IRead;
+      break;
+    }
+    case Write: {
+      auto s = static_cast<const StmtWrite*>(stmt);
+      inst.op = IWrite;
+      set_operand(inst, 0, s->get_val());
+      break;
+    }
+    default:
+      break;
+  }
+
+  pending.branches.emplace_back(target1, target2);
+  pending.callees.push_back(callee);
+  return inst;
+}
+
+static bool is_bop(const Inst& inst) {
+  return inst.op == IBop || inst.op == IBopRR || inst.op == IBopRI;
+}
+
+static bool reads_reg(const Inst& inst, int n, uint8_t reg) {
+  for (int i = 0; i < n; i++) {
+    if (inst.reg[i] == reg)
+      return true;
+  }
+  return false;
+}
+
+/** a comparison whose result is the condition of the br right after it */
+static bool is_icmp_br(const Inst* code) {
+  return is_bop(code[0]) && code[0].sub >= Eq && code[1].op == IBrCond && code[1].reg[0] == code[0].lhs;
+}
+
+/**
+ * turns runs that compiled code is full of into superinstructions:
+ *   load + bop that reads it              -> ILoadBop
+ *   icmp + br on its result               -> IIcmpBr
+ *   incr/decr + icmp that reads it + br   -> IUopIcmpBr (a loop latch)
+ * a run never spans blocks, since only terminators end one and a br is
+ * only ever the last of a run. the load must not be async, whose result
+ * the bop would have to wait for.
+ */
+static void fuse_instructions(BytecodeFunction& bfunc) {
+  auto& code = bfunc.code;
+  for (size_t i = 0; i + 1 < code.size(); i++) {
+    Inst* run = &code[i];
+    if (i + 2 < code.size() && run[0].op == IUop && is_icmp_br(run + 1) && reads_reg(run[1], 2, run[0].lhs)) {
+      run[0].op = IUopIcmpBr;
+      i += 2;
+    } else if (is_icmp_br(run)) {
+      run[0].op = IIcmpBr;
+      i += 1;
+    } else if (run[0].op == ILoad && !run[0].sub && is_bop(run[1]) && reads_reg(run[1], 2, run[0].lhs)) {
+      run[0].op = ILoadBop;
+      i += 1;
+    }
+  }
+}
+
+static void lower_function(const Function& function, BytecodeFunction& bfunc, PendingTargets& pending) {
+  bfunc.function = &function;
+
+  // blocks are laid out in source order, which starts with the entry block
+  const Stmt* entry = function.get_first_bb();
+  map<const Stmt*, size_t> block_index;
+  for (auto& it: function.get_bbs()) {
+    block_index[it.second] = bfunc.code.size();
+    for (const Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next())
+      bfunc.code.push_back(lower_stmt(stmt, bfunc, pending));
+  }
+  fuse_instructions(bfunc);
+
+  auto resolve = [&](const Stmt* stmt) -> const Inst* {
+    auto it = block_index.find(stmt);
+    if (stmt == nullptr || it == block_index.end())
+      return nullptr;
+    return &bfunc.code[it->second];
+  };
+
+  for (size_t i = 0; i < bfunc.code.size(); i++) {
+    if (bfunc.code[i].op != IBrUncond && bfunc.code[i].op != IBrCond)
+      continue;
+    bfunc.code[i].target[0] = resolve(pending.branches[i].first);
+    bfunc.code[i].target[1] = resolve(pending.branches[i].second);
+  }
+  bfunc.jump_tables.resize(pending.switches.size());
+  for (size_t i = 0; i < pending.switches.size(); i++) {
+    const StmtSwitch* s = pending.switches[i];
+    vector<pair<uint64_t, const Inst*>> cases;
+    for (auto& it: s->get_cases())
+      cases.emplace_back(it.first, resolve(it.second));
+    bfunc.jump_tables[i].build(cases, resolve(s->get_default_bb()));
+  }
+
+  bfunc.entry = resolve(entry);
+}
+
+BytecodeProgram::BytecodeProgram(const Program& program) {
+  auto& program_functions = program.get_functions();
+  functions.resize(program_functions.size());
+  vector<PendingTargets> pending(program_functions.size());
+
+  for (size_t i = 0; i < program_functions.size(); i++) {
+    lower_function(*program_functions[i], functions[i], pending[i]);
+    function_map[program_functions[i]] = &functions[i];
+  }
+
+  // calls can only be resolved once every function has been lowered
+  for (size_t i = 0; i < functions.size(); i++) {
+    auto& code = functions[i].code;
+    for (size_t j = 0; j < code.size(); j++) {
+      if (code[j].op == ICall)
+        code[j].callee = get_function(pending[i].callees[j]);
+    }
+  }
+}
+
+vector<BytecodeFunction>& BytecodeProgram::get_functions() { return functions; }
+
+const BytecodeFunction* BytecodeProgram::get_function(const Function* function) const {
+  auto it = function_map.find(function);
+  if (it == function_map.end())
+    return nullptr;
+  return it->second;
+}
@@ -0,0 +1,119 @@
+#ifndef SWPP_ASM_INTERPRETER_BYTECODE_H
+#define SWPP_ASM_INTERPRETER_BYTECODE_H
+
+#include <cinttypes>
+#include <vector>
+#include <map>
+
+#include "program.h"
+#include "jumptable.h"
+#include "alu.h"
+
+using namespace std;
+
+
+enum InstOp {
+  // terminators
+  IRet = 0,
+  IBrUncond,
+  IBrCond,
+  ISwitch,
+
+  // memory operations
+  IMalloc,
+  IFree,
+  ILoad,
+  IStore,
+
+  // arithmetic
+  IBop,
+  IBopRR,
+  IBopRI,
+  ISum,
+  IUop,
+  ISelect,
+
+  // function call
+  ICall,
+
+  // assertion
+  IAssert,
+
+  // read and write
+  IRead,
+  IWrite,
+
+  // superinstructions, see fuse_instructions
+  ILoadBop,
+  IIcmpBr,
+  IUopIcmpBr,
+
+  LEN_INSTOP
+};
+
+struct BytecodeFunction;
+
+/**
+ * a pre-decoded instruction. operand i is the register reg[i], or the
+ * immediate imm[i] when reg[i] is RegNone. instructions with more operands
+ * than fit in place keep them in their function's side tables:
+ *   Load:   op0 = ptr, imm[1] = offset, size = MSize, sub = is_async
+ *   Store:  op0 = val, op1 = ptr, imm[2] = offset, size = MSize
+ *   Bop:    op0, op1, size = Size, sub = BopKind, bop_kernel; IBopRR when
+ *           both operands are registers, IBopRI when only op0 is
+ *   Uop:    op0, size = Size, sub = UopKind, uop_kernel
+ *   Sum:    operands[aux .. aux + 8), size = Size
+ *   Switch: op0 = cond, jump_tables[aux]
+ *   Call:   operands[aux .. aux + imm[0]), callee, imm[1] = registers to
+ *           save (StmtCall::get_saved_regs), imm[2] = StmtCall::get_arg_regs
+ * a branch target is null when its label is undefined.
+ *
+ * a superinstruction replaces the op of the first instruction of a run it
+ * executes in one go; the rest of the run keeps its own instructions, which
+ * the handler reads its operands from.
+ */
+struct Inst {
+  const void* handler;
+  uint8_t op;
+  uint8_t lhs;
+  uint8_t size;
+  uint8_t sub;
+  int32_t line;
+  uint8_t reg[3];
+  uint32_t aux;
+  uint64_t imm[3];
+  union {
+    const Inst* target[2];
+    const BytecodeFunction* callee;
+    BopKernel bop_kernel;
+    UopKernel uop_kernel;
+  };
+};
+
+struct Operand {
+  uint64_t imm;
+  uint8_t reg;
+};
+
+struct BytecodeFunction {
+  const Function* function;
+  vector<Inst> code;
+  vector<Operand> operands;
+  vector<JumpTable<const Inst*>> jump_tables;
+  const Inst* entry;
+};
+
+
+class BytecodeProgram {
+private:
+  vector<BytecodeFunction> functions;
+  map<const Function*, BytecodeFunction*> function_map;
+
+public:
+  explicit BytecodeProgram(const Program& program);
+
+  vector<BytecodeFunction>& get_functions();
+  const BytecodeFunction* get_function(const Function* function) const;
+};
+
+#endif //SWPP_ASM_INTERPRETER_BYTECODE_H
@@ -0,0 +1,204 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "state.h"
+
+using namespace std;
+
+
+void print_usage() {
+  cout << "USAGE: swpp-client --socket=<socket> [--engine=tree|bytecode] [--max-call-depth=N] "
+          "[--cost-tree=contexts|calls] <input assembly file>" << endl;
+}
+
+/** handles the frames complete in buf, and drops them; true once the exit code came */
+static bool handle_frames(string& buf, int& exit_code) {
+  size_t pos = 0;
+  bool done = false;
+  while (!done && buf.size() - pos >= FRAME_HEADER_SIZE) {
+    char kind = buf[pos];
+    uint64_t len;
+    memcpy(&len, buf.data() + pos + 1, sizeof(len));
+    if (buf.size() - pos - FRAME_HEADER_SIZE < len)
+      break;
+    string_view payload(buf.data() + pos + FRAME_HEADER_SIZE, len);
+    pos += FRAME_HEADER_SIZE + len;
+
+    if (kind == 'o') {
+      fwrite(payload.data(), 1, payload.size(), stdout);
+      fflush(stdout);
+    } else if (kind == 'l') {
+      size_t split = payload.find('\0');
+      string name(payload.substr(0, split));
+      if (split != string_view::npos && name.find('/') == string::npos) {
+        ofstream log(name);
+        log << payload.substr(split + 1);
+        log.close();
+      }
+    } else if (kind == 'x') {
+      exit_code = payload.empty() ? EXIT_FAILURE : (uint8_t)payload[0];
+      done = true;
+    }
+  }
+  buf.erase(0, pos);
+  return done;
+}
+
+/**
+ * runs filename on the server at socket_path, and behaves like a local run:
+ * stdin is the guest's input, the output goes to stdout, the logs to the
+ * current directory, and the exit code is the run's
+ */
+static int run_client(const string& socket_path, const string& filename, EngineKind engine, CostTreeKind cost_tree,
+                      size_t max_call_depth) {
+  ifstream file(filename, ios::binary);
+  if (!file) {
+    cout << "Error: cannot find " << filename << endl;
+    return 1;
+  }
+  stringstream source;
+  source << file.rdbuf();
+
+  sockaddr_un addr;
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || !make_address(socket_path, addr) || connect(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    cout << "Error: cannot connect to " << socket_path << endl;
+    return 1;
+  }
+
+  string job = PROTOCOL_MAGIC;
+  uint8_t engine_kind = engine;
+  uint8_t cost_tree_kind = cost_tree;
+  uint64_t depth = max_call_depth;
+  job.append((const char*)&engine_kind, sizeof(engine_kind));
+  job.append((const char*)&cost_tree_kind, sizeof(cost_tree_kind));
+  job.append((const char*)&depth, sizeof(depth));
+  append_string(job, filename);
+  append_string(job, source.str());
+  if (!send_all(sock, job.data(), job.size())) {
+    cout << "Error: cannot connect to " << socket_path << endl;
+    return 1;
+  }
+
+  // stdin goes to the server while the output comes back; neither may wait for the other
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+  char buf[1 << 16];
+  string input;
+  size_t input_pos = 0;
+  bool input_eof = false;
+  bool shut = false;
+  string frames;
+  int exit_code = EXIT_FAILURE;
+
+  while (true) {
+    pollfd fds[2];
+    int nfds = 1;
+    fds[0] = pollfd { sock, (short)(POLLIN | (input_pos < input.size() ? POLLOUT : 0)), 0 };
+    if (!input_eof && input_pos == input.size())
+      fds[nfds++] = pollfd { STDIN_FILENO, POLLIN, 0 };
+    if (poll(fds, nfds, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (nfds == 2 && fds[1].revents != 0) {
+      ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+      if (n > 0) {
+        input.assign(buf, n);
+        input_pos = 0;
+      } else if (n == 0 || errno != EINTR) {
+        input_eof = true;
+      }
+    }
+
+    if (fds[0].revents & POLLOUT) {
+      ssize_t n = send(sock, input.data() + input_pos, input.size() - input_pos, MSG_NOSIGNAL);
+      if (n > 0) {
+        input_pos += n;
+      } else if (errno != EAGAIN && errno != EINTR) {
+        // the run is over and does not want the rest
+        input_eof = true;
+        input_pos = input.size();
+      }
+    }
+
+    if (input_eof && input_pos == input.size() && !shut) {
+      shutdown(sock, SHUT_WR);
+      shut = true;
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t n = recv(sock, buf, sizeof(buf), 0);
+      if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        continue;
+      if (n <= 0)
+        break;
+      frames.append(buf, n);
+      if (handle_frames(frames, exit_code)) {
+        close(sock);
+        return exit_code;
+      }
+    }
+  }
+
+  close(sock);
+  cout << "Error: lost the connection to " << socket_path << endl;
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  EngineKind engine = EngineTree;
+  CostTreeKind cost_tree = CostTreeContexts;
+  size_t max_call_depth = DEFAULT_MAX_CALL_DEPTH;
+  string socket_path;
+  string filename;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--engine=tree")
+      engine = EngineTree;
+    else if (arg == "--engine=bytecode")
+      engine = EngineBytecode;
+    else if (arg == "--cost-tree=contexts")
+      cost_tree = CostTreeContexts;
+    else if (arg == "--cost-tree=calls")
+      cost_tree = CostTreeCalls;
+    else if (arg.rfind("--socket=", 0) == 0)
+      socket_path = arg.substr(strlen("--socket="));
+    else if (arg.rfind("--max-call-depth=", 0) == 0) {
+      string depth = arg.substr(strlen("--max-call-depth="));
+      try {
+        if (depth.find_first_not_of("0123456789") != string::npos)
+          throw invalid_argument(depth);
+        max_call_depth = stoull(depth);
+      } catch (exception& e) {
+        print_usage();
+        return 1;
+      }
+    }
+    else if (arg.rfind("--", 0) != 0 && filename.empty())
+      filename = arg;
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if (socket_path.empty() || filename.empty()) {
+    print_usage();
+    return 1;
+  }
+
+  return run_client(socket_path, filename, engine, cost_tree, max_call_depth);
+}
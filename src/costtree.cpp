@@ -0,0 +1,55 @@
+#include <iomanip>
+#include <vector>
+
+#include "costtree.h"
+
+
+CostTree::CostTree(CostTreeKind _kind, const Function* main): arena(), kind(_kind), root(make_node(main)) {
+  root->calls = 1;
+}
+
+CostNode* CostTree::get_root() const { return root; }
+
+/**
+ * a line of a node: its function and cost, and in a tree of contexts the
+ * number of calls and their cost without the callees'
+ */
+void CostTree::write_node(ostream& out, const CostNode* node) const {
+  out << node->function->get_fname() << ": " << node->cost;
+  if (kind == CostTreeContexts) {
+    double self = node->cost;
+    for (const CostNode* callee = node->first_callee; callee != nullptr; callee = callee->next)
+      self -= callee->cost;
+    out << " (calls " << node->calls << ", self " << self << ")";
+  }
+  out << '\n';
+}
+
+/**
+ * writes the tree a node a line, each below its caller and indented one
+ * level deeper. it is walked with an explicit stack, as guest calls can
+ * nest deeper than the host stack.
+ */
+void CostTree::write(ostream& out) const {
+  out << fixed << setprecision(4);
+  write_node(out, root);
+
+  // the next callee to write at every level
+  vector<const CostNode*> stack;
+  stack.push_back(root->first_callee);
+  string indent;
+  while (!stack.empty()) {
+    const CostNode* node = stack.back();
+    if (node == nullptr) {
+      stack.pop_back();
+      continue;
+    }
+    stack.back() = node->next;
+
+    if (indent.size() < 2 * stack.size())
+      indent += "| ";
+    out.write(indent.data(), 2 * stack.size());
+    write_node(out, node);
+    stack.push_back(node->first_callee);
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef SWPP_ASM_INTERPRETER_COSTTREE_H
+#define SWPP_ASM_INTERPRETER_COSTTREE_H
+
+#include <cinttypes>
+#include <ostream>
+
+#include "function.h"
+#include "arena.h"
+
+using namespace std;
+
+
+enum CostTreeKind {
+  /** a node per calling context, merging the calls made along it */
+  CostTreeContexts = 0,
+  /** a node per call, as the cost log used to be */
+  CostTreeCalls
+};
+
+/**
+ * a call path and what the calls made along it cost, their callees
+ * included. the callees are in the order they were first called.
+ */
+struct CostNode {
+  const Function* function;
+  uint64_t calls;
+  double cost;
+  CostNode* first_callee;
+  CostNode* last_callee;
+  CostNode* next;
+};
+
+
+/**
+ * the cost of a run by call path. calls to the same function from the same
+ * context share a node, so the tree takes memory by the number of paths,
+ * not of calls; a tree of calls gives every call a node of its own
+ * instead. the nodes are placed in the tree's arena.
+ */
+class CostTree {
+private:
+  Arena arena;
+  const CostTreeKind kind;
+  CostNode* root;
+
+  CostNode* make_node(const Function* function);
+  void write_node(ostream& out, const CostNode* node) const;
+
+public:
+  CostTree(CostTreeKind _kind, const Function* main);
+  CostTree(const CostTree&) = delete;
+  CostTree& operator=(const CostTree&) = delete;
+
+  CostNode* get_root() const;
+  CostNode* enter(CostNode* caller, const Function* callee);
+  void write(ostream& out) const;
+};
+
+
+/** a call is entered on every call the engines run */
+
+inline CostNode* CostTree::make_node(const Function* function) {
+  return arena.make<CostNode>(CostNode { function, 0, 0, nullptr, nullptr, nullptr });
+}
+
+/** the node of a call from the context of caller to callee, counting the call */
+inline CostNode* CostTree::enter(CostNode* caller, const Function* callee) {
+  CostNode* node = nullptr;
+  if (kind == CostTreeContexts) {
+    for (node = caller->first_callee; node != nullptr && node->function != callee; node = node->next);
+  }
+  if (node == nullptr) {
+    node = make_node(callee);
+    if (caller->last_callee == nullptr)
+      caller->first_callee = node;
+    else
+      caller->last_callee->next = node;
+    caller->last_callee = node;
+  }
+  node->calls++;
+  return node;
+}
+
+#endif //SWPP_ASM_INTERPRETER_COSTTREE_H
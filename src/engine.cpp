@@ -0,0 +1,557 @@
+#include "state.h"
+#include "alu.h"
+
+
+static inline double wait_cost_of(double cost_acc, double wait_until) {
+  return cost_acc >= wait_until ? 0 : wait_until - cost_acc;
+}
+
+static inline pair<uint64_t, double> read_operand(RegFile& regfile, uint8_t reg, uint64_t imm) {
+  if (reg == RegNone)
+    return make_pair(imm, -1.0);
+  return regfile.read_reg((Reg)reg);
+}
+
+static inline pair<uint64_t, double> peek_operand(const RegFile& regfile, uint8_t reg, uint64_t imm) {
+  if (reg == RegNone)
+    return make_pair(imm, -1.0);
+  return regfile.peek_reg((Reg)reg);
+}
+
+/**
+ * executes a lowered function on machine M with direct-threaded dispatch,
+ * charging its cost to cost_node. every handler mirrors the corresponding
+ * Stmt::exec (and the Stmt cases of exec_function) operation by operation,
+ * so costs, logs and errors stay identical to the statement engine. calls
+ * push a BytecodeFrame rather than recursing, like exec_function does.
+ *
+ * the engine is instantiated once per machine, so costs are immediates. the
+ * normal engine runs main and everything it calls but the oracle, which it
+ * hands to the oracle engine; the oracle cannot call, so that engine only
+ * ever runs one function and returns from its ret.
+ *
+ * the engine is also instantiated once more for profiled runs (P), which
+ * tell the profile what the statement engine does (see Profile).
+ *
+ * called with a null function, it only stores the handler address of every
+ * instruction it runs, which must happen once before running (see
+ * Program::get_bytecode).
+ */
+template <MachineKind M, bool P>
+uint64_t State::exec_bytecode(const BytecodeFunction* function, CostNode* cost_node) {
+  static const void* const handlers[LEN_INSTOP] = {
+    &&do_ret, &&do_br_uncond, &&do_br_cond, &&do_switch,
+    &&do_malloc, &&do_free, &&do_load, &&do_store,
+    &&do_bop, &&do_bop_rr, &&do_bop_ri, &&do_sum, &&do_uop, &&do_select,
+    &&do_call, &&do_assert, &&do_read, &&do_write,
+    &&do_load_bop, &&do_icmp_br, &&do_uop_icmp_br,
+  };
+
+  if (function == nullptr) {
+    for (auto& bfunc: bytecode->get_functions()) {
+      if (bfunc.function->is_oracle_function() != (M == Oracle))
+        continue;
+      for (auto& inst: bfunc.code)
+        inst.handler = handlers[inst.op];
+    }
+    return 0;
+  }
+
+  const Inst* ip = function->entry;
+  if (ip == nullptr) {
+    invoke_runtime_error("missing first basic block");
+    return 0;
+  }
+
+  double cost = 0;
+  constexpr const Machine& mach = machine_of<M>();
+  constexpr const Cost& mc = *mach.machine_cost;
+  double* cost_log = cost_per_inst[M];
+  int* count_log = inst_count[M];
+
+#define OPERAND(I) read_operand(regfile, ip->reg[I], ip->imm[I])
+#define LOG(OPCODE, INST_COST, WAIT_COST) do { \
+    cost_log[OPCODE] += (INST_COST); count_log[OPCODE]++; total_wait_cost += (WAIT_COST); \
+    if (P) profile->add_wait(ip->line, (WAIT_COST)); \
+    PROFILE_ASYNC(INST_COST, WAIT_COST); \
+  } while (0)
+/** LOG with a wait cost of 0, which leaves the total as it is */
+#define LOG_NO_WAIT(OPCODE, INST_COST) do { cost_log[OPCODE] += (INST_COST); count_log[OPCODE]++; } while (0)
+/** the cost of an instruction whose cost depends on the run, and the end of a block */
+#define PROFILE_COST(INST_COST) do { if (P) profile->add_cost(ip->line, (INST_COST)); } while (0)
+#define PROFILE_BLOCK() do { if (P) profile->add_block(ip->line); } while (0)
+/** after an instruction has been charged, what it read or overwrote of the async loads in flight */
+#define PROFILE_ASYNC(INST_COST, WAIT_COST) do { \
+    if (P) profile->resolve_async(regfile, ip->line, cost - (INST_COST) - (WAIT_COST), (WAIT_COST)); \
+  } while (0)
+#define PROFILE_TAKEN(EVAL) do { if (P && (EVAL)) profile->add_taken(ip->line); } while (0)
+/** a value at a site of the instruction, and the divisor of a bop that is a udiv or urem */
+#define PROFILE_VALUE(OPERAND, VALUE) do { \
+    if (P && profile->counts_values()) profile->add_value(ip->line, (OPERAND), (VALUE)); \
+  } while (0)
+#define PROFILE_DIVISOR(VALUE) do { \
+    if (P && ((BopKind)ip->sub == Udiv || (BopKind)ip->sub == Urem)) PROFILE_VALUE(0, (VALUE)); \
+  } while (0)
+#define DISPATCH() do { line = ip->line; goto *ip->handler; } while (0)
+#define NEXT() do { ip++; DISPATCH(); } while (0)
+#define JUMP(TARGET) do { ip = (TARGET); DISPATCH(); } while (0)
+/** moves on to the next instruction of a superinstruction, which errors report */
+#define STEP() do { ip++; line = ip->line; } while (0)
+/** the callee's ret has added its cost to the frame */
+#define RETURN_TO_CALLER(VAL) do { \
+    BytecodeFrame& frame = bytecode_frames.back(); \
+    cost = frame.cost; \
+    cost_node = frame.cost_node; \
+    function = frame.function; \
+    pop_saved_regs(frame.saved); \
+    regfile.set_nargs(frame.nargs); \
+    regfile.write_reg((Reg)frame.call->lhs, (VAL)); \
+    if (P) { \
+      profile->leave_call(frame.saved); \
+      profile->resolve_async(regfile, frame.call->line, cost, 0); \
+    } \
+    ip = frame.call; \
+    bytecode_frames.pop_back(); \
+    NEXT(); \
+  } while (0)
+
+  DISPATCH();
+
+  do_ret: {
+    auto ret = OPERAND(0);
+    double wait_cost = wait_cost_of(cost, ret.second);
+    cost += mc.RET + wait_cost;
+    LOG(Ret, mc.RET, wait_cost);
+    PROFILE_BLOCK();
+    cost_node->cost += cost;
+    if (!bytecode_frames.empty())
+      bytecode_frames.back().cost += cost;
+    // the oracle engine returns to the normal one, which pops the frame
+    if (M == Oracle || bytecode_frames.empty())
+      return ret.first;
+    RETURN_TO_CALLER(ret.first);
+  }
+
+  do_br_uncond: {
+    const Inst* next = ip->target[0];
+    if (next == nullptr) {
+      invoke_runtime_error("branching to an undefined basic block");
+      return 0;
+    }
+    cost += mc.BRUNCOND;
+    LOG(BrUncond, mc.BRUNCOND, 0);
+    PROFILE_BLOCK();
+    JUMP(next);
+  }
+
+  do_br_cond: {
+    auto c = OPERAND(0);
+    bool eval = c.first != 0;
+    double wait_cost = wait_cost_of(cost, c.second);
+    const Inst* next = ip->target[eval ? 0 : 1];
+    if (next == nullptr) {
+      invoke_runtime_error("branching to an undefined basic block");
+      return 0;
+    }
+    double inst_cost = eval ? mc.BRCOND_TRUE : mc.BRCOND_FALSE;
+    cost += inst_cost + wait_cost;
+    LOG(BrCond, inst_cost, wait_cost);
+    PROFILE_COST(inst_cost);
+    PROFILE_BLOCK();
+    PROFILE_TAKEN(eval);
+    JUMP(next);
+  }
+
+  do_switch: {
+    auto c = OPERAND(0);
+    const Inst* next = function->jump_tables[ip->aux].lookup(c.first);
+    double wait_cost = wait_cost_of(cost, c.second);
+    if (next == nullptr) {
+      invoke_runtime_error("branching to an undefined basic block");
+      return 0;
+    }
+    cost += mc.SWITCH + wait_cost;
+    LOG(Switch, mc.SWITCH, wait_cost);
+    PROFILE_BLOCK();
+    if (P)
+      profile->add_case(ip->line, c.first);
+    PROFILE_VALUE(0, c.first);
+    JUMP(next);
+  }
+
+  do_malloc: {
+    auto size = OPERAND(0);
+    uint64_t addr;
+    double inst_cost = memory.exec_malloc(mach, size.first, addr);
+    regfile.write_reg((Reg)ip->lhs, addr);
+    double wait_cost = wait_cost_of(cost, size.second);
+    cost += inst_cost + wait_cost;
+    LOG(Malloc, inst_cost, wait_cost);
+    NEXT();
+  }
+
+  do_free: {
+    auto addr = OPERAND(0);
+    double inst_cost = memory.exec_free(mach, addr.first);
+    double wait_cost = wait_cost_of(cost, addr.second);
+    cost += inst_cost + wait_cost;
+    LOG(Free, inst_cost, wait_cost);
+    NEXT();
+  }
+
+  do_load: {
+    auto res = OPERAND(0);
+    auto size = (MSize)ip->size;
+    uint64_t addr = res.first + ip->imm[1];
+    uint64_t result;
+    double inst_cost = memory.exec_load(mach, ip->sub, size, addr, result);
+    double wait_cost = wait_cost_of(cost, res.second);
+    regfile.write_reg((Reg)ip->lhs, result);
+
+    if (ip->sub) {
+      if (is_stack(size, addr))
+        regfile.set_async((Reg)ip->lhs, cost + wait_cost + mc.ALOAD + mc.WAIT_STACK);
+      else if (is_heap(size, addr))
+        regfile.set_async((Reg)ip->lhs, cost + wait_cost + mc.ALOAD + mc.WAIT_HEAP);
+      else
+        invoke_runtime_error("accessing address between 10248 and 20480");
+    }
+
+    cost += inst_cost + wait_cost;
+    LOG(Load, inst_cost, wait_cost);
+    PROFILE_COST(inst_cost);
+    PROFILE_VALUE(0, result);
+    if (P && ip->sub) {
+      profile->issue_async((Reg)ip->lhs, ip->line, cost - inst_cost - wait_cost, cost,
+                           regfile.peek_reg((Reg)ip->lhs).second, is_heap(size, addr));
+    }
+    NEXT();
+  }
+
+  do_store: {
+    auto res = OPERAND(1);
+    uint64_t addr = res.first + ip->imm[2];
+    auto v = OPERAND(0);
+    double wait_cost = max(wait_cost_of(cost, res.second), wait_cost_of(cost, v.second));
+    double inst_cost = memory.exec_store(mach, (MSize)ip->size, addr, v.first);
+    cost += inst_cost + wait_cost;
+    LOG(Store, inst_cost, wait_cost);
+    PROFILE_COST(inst_cost);
+    NEXT();
+  }
+
+  do_bop: {
+    auto op1 = OPERAND(0);
+    auto op2 = OPERAND(1);
+    uint64_t res = ip->bop_kernel(op1.first, op2.first);
+    regfile.write_reg((Reg)ip->lhs, res);
+    double wait_cost = max(wait_cost_of(cost, op1.second), wait_cost_of(cost, op2.second));
+    double inst_cost = cost_of(mc, (BopKind)ip->sub);
+    cost += inst_cost + wait_cost;
+    LOG(Bop, inst_cost, wait_cost);
+    PROFILE_DIVISOR(op2.first);
+    NEXT();
+  }
+
+  do_bop_rr: {
+    auto op1 = regfile.read_reg((Reg)ip->reg[0]);
+    auto op2 = regfile.read_reg((Reg)ip->reg[1]);
+    uint64_t res = ip->bop_kernel(op1.first, op2.first);
+    regfile.write_reg((Reg)ip->lhs, res);
+    double wait_cost = max(wait_cost_of(cost, op1.second), wait_cost_of(cost, op2.second));
+    double inst_cost = cost_of(mc, (BopKind)ip->sub);
+    cost += inst_cost + wait_cost;
+    LOG(Bop, inst_cost, wait_cost);
+    PROFILE_DIVISOR(op2.first);
+    NEXT();
+  }
+
+  do_bop_ri: {
+    // a constant never waits
+    auto op1 = regfile.read_reg((Reg)ip->reg[0]);
+    uint64_t res = ip->bop_kernel(op1.first, ip->imm[1]);
+    regfile.write_reg((Reg)ip->lhs, res);
+    double wait_cost = wait_cost_of(cost, op1.second);
+    double inst_cost = cost_of(mc, (BopKind)ip->sub);
+    cost += inst_cost + wait_cost;
+    LOG(Bop, inst_cost, wait_cost);
+    PROFILE_DIVISOR(ip->imm[1]);
+    NEXT();
+  }
+
+  do_sum: {
+    uint64_t res = 0;
+    double wait_until = -1.0;
+    const Operand* ops = function->operands.data() + ip->aux;
+    for (int i = 0; i < StmtSum::num_operands; i++) {
+      auto v = read_operand(regfile, ops[i].reg, ops[i].imm);
+      res += v.first;
+      if (v.second > wait_until)
+        wait_until = v.second;
+    }
+    regfile.write_reg((Reg)ip->lhs, res);
+    double wait_cost = wait_cost_of(cost, wait_until);
+    cost += mc.SUM + wait_cost;
+    LOG(Sum, mc.SUM, wait_cost);
+    NEXT();
+  }
+
+  do_uop: {
+    auto op = OPERAND(0);
+    uint64_t res = ip->uop_kernel(op.first);
+    regfile.write_reg((Reg)ip->lhs, res);
+    double wait_cost = wait_cost_of(cost, op.second);
+    cost += mc.UOP + wait_cost;
+    LOG(Uop, mc.UOP, wait_cost);
+    NEXT();
+  }
+
+  do_select: {
+    auto v_cond = OPERAND(0);
+    auto v_true = OPERAND(1);
+    auto v_false = OPERAND(2);
+    double wait_until = v_cond.second;
+
+    if (v_cond.first != 0) {
+      if (v_true.second > wait_until)
+        wait_until = v_true.second;
+      regfile.write_reg((Reg)ip->lhs, v_true.first);
+    }
+    else {
+      if (v_false.second > wait_until)
+        wait_until = v_false.second;
+      regfile.write_reg((Reg)ip->lhs, v_false.first);
+    }
+
+    double wait_cost = wait_cost_of(cost, wait_until);
+    cost += mc.TERNARY + wait_cost;
+    LOG(Select, mc.TERNARY, wait_cost);
+    NEXT();
+  }
+
+  do_call: {
+    if (M == Oracle) {
+      invoke_runtime_error("call inside the oracle");
+      return 0;
+    }
+
+    const BytecodeFunction* callee = ip->callee;
+    if (callee == nullptr) {
+      invoke_runtime_error("calling an undefined function");
+      return 0;
+    }
+    bool callee_is_oracle = callee->function->is_oracle_function();
+
+    int nargs = callee->function->get_nargs();
+    if (nargs != (int)ip->imm[0]) {
+      invoke_runtime_error("calling with incorrect number of arguments");
+      return 0;
+    }
+
+    if (bytecode_frames.size() + 1 >= max_call_depth) {
+      invoke_runtime_error("exceeding the maximum call depth");
+      return 0;
+    }
+
+    bytecode_frames.push_back(BytecodeFrame { ip, function, cost_node, cost, ip->imm[1], regfile.get_nargs() });
+    push_saved_regs(ip->imm[1], ip->imm[2]);
+
+    uint64_t vals[NARGREGS];
+    double wait_until = -1.0;
+    const Operand* args = function->operands.data() + ip->aux;
+    for (int i = 0; i < nargs; i++) {
+      auto val = peek_operand(regfile, args[i].reg, args[i].imm);
+      vals[i] = val.first;
+      if (val.second > wait_until)
+        wait_until = val.second;
+    }
+    regfile.set_nargs(nargs);
+    for (int i = 0; i < nargs; i++) {
+      regfile.set_value((Reg)((int)A1 + i), vals[i]);
+      PROFILE_VALUE(i, vals[i]);
+    }
+    double wait_cost = wait_cost_of(cost, wait_cost_of(cost, wait_until));
+
+    // a call is charged and logged on the machine of the callee
+    double inst_cost = callee_is_oracle ? OracleCost.CALL_ORACLE + nargs * OracleCost.PER_ARG : mc.CALL + nargs * mc.PER_ARG;
+    cost += inst_cost + wait_cost;
+    if (callee_is_oracle) {
+      cost_per_inst[Oracle][Call] += inst_cost;
+      inst_count[Oracle][Call]++;
+      total_wait_cost += wait_cost;
+      if (P) profile->add_wait(ip->line, wait_cost);
+      PROFILE_ASYNC(inst_cost, wait_cost);
+    } else {
+      LOG(Call, inst_cost, wait_cost);
+    }
+    PROFILE_COST(inst_cost);
+    if (P)
+      profile->enter_call(ip->line, cost - inst_cost - wait_cost, ip->imm[1], ip->imm[2]);
+    bytecode_frames.back().cost = cost;
+
+    cost_node = cost_tree->enter(cost_node, callee->function);
+    cost = 0;
+    if (callee_is_oracle) {
+      uint64_t ret = exec_bytecode<Oracle, P>(callee, cost_node);
+      RETURN_TO_CALLER(ret);
+    }
+    function = callee;
+    if (function->entry == nullptr) {
+      invoke_runtime_error("missing first basic block");
+      return 0;
+    }
+    JUMP(function->entry);
+  }
+
+  do_assert: {
+    auto val1 = OPERAND(0);
+    auto val2 = OPERAND(1);
+    double wait_until = max(val1.second, val2.second);
+
+    if (val1.first != val2.first) {
+      invoke_assertion_failed(regfile);
+      return 0;
+    }
+
+    double wait_cost = wait_cost_of(cost, wait_until);
+    cost += mc.ASSERT + wait_cost;
+    LOG(Assert, mc.ASSERT, wait_cost);
+    NEXT();
+  }
+
+  do_read: {
+    uint64_t result;
+    if (!io.read_input(result)) {
+      invoke_runtime_error("invalid input");
+      return 0;
+    }
+    regfile.write_reg((Reg)ip->lhs, result);
+    cost += mc.CALL + 0;
+    LOG(Read, mc.CALL, 0);
+    NEXT();
+  }
+
+  do_write: {
+    auto result = OPERAND(0);
+    io.write_output(result.first);
+    regfile.write_reg((Reg)ip->lhs, 0);
+    double inst_cost = mc.CALL + mc.PER_ARG;
+    double wait_cost = wait_cost_of(cost, result.second);
+    cost += inst_cost + wait_cost;
+    LOG(Write, inst_cost, wait_cost);
+    NEXT();
+  }
+
+  /**
+   * superinstructions run their instructions one after the other exactly
+   * as the plain handlers do, and log each on its own. a br takes its
+   * condition from the icmp just before it, which was written and has
+   * nothing to wait for, as a read of the register would find.
+   */
+
+  do_load_bop: {
+    auto res = OPERAND(0);
+    auto size = (MSize)ip->size;
+    uint64_t addr = res.first + ip->imm[1];
+    uint64_t result;
+    double inst_cost = memory.exec_load(mach, false, size, addr, result);
+    double wait_cost = wait_cost_of(cost, res.second);
+    regfile.write_reg((Reg)ip->lhs, result);
+    cost += inst_cost + wait_cost;
+    LOG(Load, inst_cost, wait_cost);
+    PROFILE_COST(inst_cost);
+    PROFILE_VALUE(0, result);
+
+    STEP();
+    auto op1 = OPERAND(0);
+    auto op2 = OPERAND(1);
+    uint64_t res2 = ip->bop_kernel(op1.first, op2.first);
+    regfile.write_reg((Reg)ip->lhs, res2);
+    wait_cost = max(wait_cost_of(cost, op1.second), wait_cost_of(cost, op2.second));
+    inst_cost = cost_of(mc, (BopKind)ip->sub);
+    cost += inst_cost + wait_cost;
+    LOG(Bop, inst_cost, wait_cost);
+    PROFILE_DIVISOR(op2.first);
+    NEXT();
+  }
+
+  do_icmp_br: {
+    auto op1 = OPERAND(0);
+    auto op2 = OPERAND(1);
+    uint64_t res = ip->bop_kernel(op1.first, op2.first);
+    regfile.write_reg((Reg)ip->lhs, res);
+    double wait_cost = max(wait_cost_of(cost, op1.second), wait_cost_of(cost, op2.second));
+    double inst_cost = cost_of(mc, (BopKind)ip->sub);
+    cost += inst_cost + wait_cost;
+    LOG(Bop, inst_cost, wait_cost);
+
+    STEP();
+    bool eval = res != 0;
+    const Inst* next = ip->target[eval ? 0 : 1];
+    if (next == nullptr) {
+      invoke_runtime_error("branching to an undefined basic block");
+      return 0;
+    }
+    inst_cost = eval ? mc.BRCOND_TRUE : mc.BRCOND_FALSE;
+    cost += inst_cost;
+    LOG_NO_WAIT(BrCond, inst_cost);
+    PROFILE_COST(inst_cost);
+    PROFILE_BLOCK();
+    PROFILE_TAKEN(eval);
+    JUMP(next);
+  }
+
+  do_uop_icmp_br: {
+    auto op = OPERAND(0);
+    uint64_t res = ip->uop_kernel(op.first);
+    regfile.write_reg((Reg)ip->lhs, res);
+    double wait_cost = wait_cost_of(cost, op.second);
+    cost += mc.UOP + wait_cost;
+    LOG(Uop, mc.UOP, wait_cost);
+
+    STEP();
+    auto op1 = OPERAND(0);
+    auto op2 = OPERAND(1);
+    res = ip->bop_kernel(op1.first, op2.first);
+    regfile.write_reg((Reg)ip->lhs, res);
+    wait_cost = max(wait_cost_of(cost, op1.second), wait_cost_of(cost, op2.second));
+    double inst_cost = cost_of(mc, (BopKind)ip->sub);
+    cost += inst_cost + wait_cost;
+    LOG(Bop, inst_cost, wait_cost);
+
+    STEP();
+    bool eval = res != 0;
+    const Inst* next = ip->target[eval ? 0 : 1];
+    if (next == nullptr) {
+      invoke_runtime_error("branching to an undefined basic block");
+      return 0;
+    }
+    inst_cost = eval ? mc.BRCOND_TRUE : mc.BRCOND_FALSE;
+    cost += inst_cost;
+    LOG_NO_WAIT(BrCond, inst_cost);
+    PROFILE_COST(inst_cost);
+    PROFILE_BLOCK();
+    PROFILE_TAKEN(eval);
+    JUMP(next);
+  }
+
+#undef OPERAND
+#undef LOG
+#undef LOG_NO_WAIT
+#undef PROFILE_COST
+#undef PROFILE_BLOCK
+#undef PROFILE_TAKEN
+#undef PROFILE_ASYNC
+#undef PROFILE_VALUE
+#undef PROFILE_DIVISOR
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef STEP
+#undef RETURN_TO_CALLER
+}
+
+template uint64_t State::exec_bytecode<Normal, false>(const BytecodeFunction* function, CostNode* cost_node);
+template uint64_t State::exec_bytecode<Oracle, false>(const BytecodeFunction* function, CostNode* cost_node);
+template uint64_t State::exec_bytecode<Normal, true>(const BytecodeFunction* function, CostNode* cost_node);
+template uint64_t State::exec_bytecode<Oracle, true>(const BytecodeFunction* function, CostNode* cost_node);
@@ -1,24 +1,48 @@
-#include <iostream>
-#include <cstdlib>
-
 #include "error.h"
+#include "regfile.h"
+
+
+Status::Status(): kind(ErrorNone), filename(), line(0), msg() {}
+
+Status::Status(ErrorKind _kind, string _filename, int _line, string _msg):
+kind(_kind), filename(move(_filename)), line(_line), msg(move(_msg)) {}
+
+bool Status::ok() const { return kind == ErrorNone; }
+
+ErrorKind Status::get_kind() const { return kind; }
+
+const string& Status::get_filename() const { return filename; }
+
+int Status::get_line() const { return line; }
+
+const string& Status::get_message() const { return msg; }
+
+string Status::to_string() const {
+  string where = filename + ":" + std::to_string(line);
+  switch (kind) {
+    case ErrorNone: return "";
+    case ErrorFile: return "Error: cannot find " + filename;
+    case ErrorSyntax: return "Syntax error at " + where + ": " + msg;
+    case ErrorRuntime: return "Runtime error at " + where + ": " + msg;
+    case ErrorAssertion: return "Assertion failed at " + where + "\nRegisters: " + msg;
+  }
+  return "";
+}
+
+Error::Error(ErrorKind _kind, string _msg): kind(_kind), msg(move(_msg)) {}
 
+ErrorKind Error::get_kind() const { return kind; }
 
-string error_filename;
-int error_line_num = 0;
+const string& Error::get_message() const { return msg; }
 
 void invoke_syntax_error(const string& msg) {
-  cout << "Syntax error at " << error_filename << ":" << error_line_num << ": " << msg << endl;
-  exit(EXIT_FAILURE);
+  throw Error(ErrorSyntax, msg);
 }
 
 void invoke_runtime_error(const string& msg) {
-  cout << "Runtime error at " << error_filename << ":" << error_line_num << ": " << msg << endl;
-  exit(EXIT_FAILURE);
+  throw Error(ErrorRuntime, msg);
 }
 
 void invoke_assertion_failed(const RegFile& regfile) {
-  cout << "Assertion failed at " << error_filename << ":" << error_line_num << endl;
-  cout << "Registers: " << regfile.to_string() << endl;
-  exit(EXIT_FAILURE);
+  throw Error(ErrorAssertion, regfile.to_string());
 }
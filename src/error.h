@@ -3,16 +3,62 @@
 
 #include <string>
 
-#include "regfile.h"
-
 using namespace std;
 
+class RegFile;
+
+
+enum ErrorKind {
+  ErrorNone = 0,
+  ErrorFile,
+  ErrorSyntax,
+  ErrorRuntime,
+  ErrorAssertion
+};
+
+/**
+ * the outcome of parsing or running a program. an error carries the file
+ * and line it happened at, and to_string prints it the way the interpreter
+ * always has.
+ */
+class Status {
+private:
+  ErrorKind kind;
+  string filename;
+  int line;
+  string msg;
+
+public:
+  Status();
+  Status(ErrorKind _kind, string _filename, int _line, string _msg);
+
+  bool ok() const;
+  ErrorKind get_kind() const;
+  const string& get_filename() const;
+  int get_line() const;
+  const string& get_message() const;
+  string to_string() const;
+};
+
+/**
+ * thrown by the invoke_* functions below. it unwinds to parse or
+ * State::exec_program, which know the file and the line and turn it into a
+ * Status; nothing else catches it.
+ */
+class Error {
+private:
+  ErrorKind kind;
+  string msg;
+
+public:
+  Error(ErrorKind _kind, string _msg);
 
-extern string error_filename;
-extern int error_line_num;
+  ErrorKind get_kind() const;
+  const string& get_message() const;
+};
 
-void invoke_syntax_error(const string& msg);
-void invoke_runtime_error(const string& msg);
-void invoke_assertion_failed(const RegFile& regfile);
+[[noreturn]] void invoke_syntax_error(const string& msg);
+[[noreturn]] void invoke_runtime_error(const string& msg);
+[[noreturn]] void invoke_assertion_failed(const RegFile& regfile);
 
 #endif //SWPP_ASM_INTERPRETER_ERROR_H
@@ -0,0 +1,143 @@
+#include "freelist.h"
+
+
+static uint64_t len_of(const block_t& block) {
+  return block.second - block.first;
+}
+
+FreeList::FreeList(): root(nullptr), seed(2463534242u) {}
+
+FreeList::~FreeList() { destroy(root); }
+
+void FreeList::destroy(Node* t) {
+  if (t == nullptr)
+    return;
+  destroy(t->left);
+  destroy(t->right);
+  delete t;
+}
+
+/** xorshift32; the shape of the treap does not affect its contents */
+uint32_t FreeList::next_prio() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+void FreeList::update(Node* t) {
+  t->max_len = len_of(t->block);
+  if (t->left != nullptr && t->left->max_len > t->max_len)
+    t->max_len = t->left->max_len;
+  if (t->right != nullptr && t->right->max_len > t->max_len)
+    t->max_len = t->right->max_len;
+}
+
+/** splits t into the blocks before key (or up to key, when inclusive) and the rest */
+void FreeList::split(Node* t, const block_t& key, bool inclusive, Node*& l, Node*& r) {
+  if (t == nullptr) {
+    l = r = nullptr;
+    return;
+  }
+
+  if (t->block < key || (inclusive && t->block == key)) {
+    split(t->right, key, inclusive, t->right, r);
+    l = t;
+  } else {
+    split(t->left, key, inclusive, l, t->left);
+    r = t;
+  }
+  update(t);
+}
+
+FreeList::Node* FreeList::merge(Node* l, Node* r) {
+  if (l == nullptr)
+    return r;
+  if (r == nullptr)
+    return l;
+
+  if (l->prio > r->prio) {
+    l->right = merge(l->right, r);
+    update(l);
+    return l;
+  }
+  r->left = merge(l, r->left);
+  update(r);
+  return r;
+}
+
+bool FreeList::contains(const block_t& block) const {
+  Node* t = root;
+  while (t != nullptr) {
+    if (block == t->block)
+      return true;
+    t = block < t->block ? t->left : t->right;
+  }
+  return false;
+}
+
+void FreeList::insert(const block_t& block) {
+  if (contains(block))
+    return;
+
+  Node* node = new Node { block, len_of(block), next_prio(), nullptr, nullptr };
+  Node *l, *r;
+  split(root, block, false, l, r);
+  root = merge(merge(l, node), r);
+}
+
+void FreeList::erase(const block_t& block) {
+  Node *l, *m, *r;
+  split(root, block, false, l, r);
+  split(r, block, true, m, r);
+  destroy(m);
+  root = merge(l, r);
+}
+
+/** the first block not before key */
+bool FreeList::lower_bound(const block_t& key, block_t& result) const {
+  bool found = false;
+  for (Node* t = root; t != nullptr; ) {
+    if (t->block < key) {
+      t = t->right;
+    } else {
+      result = t->block;
+      found = true;
+      t = t->left;
+    }
+  }
+  return found;
+}
+
+/** the last block before key */
+bool FreeList::predecessor(const block_t& key, block_t& result) const {
+  bool found = false;
+  for (Node* t = root; t != nullptr; ) {
+    if (t->block < key) {
+      result = t->block;
+      found = true;
+      t = t->right;
+    } else {
+      t = t->left;
+    }
+  }
+  return found;
+}
+
+/** the first block, in set order, at least size bytes long */
+bool FreeList::first_fit(uint64_t size, block_t& result) const {
+  Node* t = root;
+  if (t == nullptr || t->max_len < size)
+    return false;
+
+  while (true) {
+    if (t->left != nullptr && t->left->max_len >= size) {
+      t = t->left;
+    } else if (len_of(t->block) >= size) {
+      result = t->block;
+      return true;
+    } else {
+      t = t->right;
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef SWPP_ASM_INTERPRETER_FREELIST_H
+#define SWPP_ASM_INTERPRETER_FREELIST_H
+
+#include <cinttypes>
+#include <utility>
+
+using namespace std;
+
+typedef pair<uint64_t, uint64_t> block_t;
+
+
+/**
+ * the free heap blocks, ordered by (start, end) exactly like a set<block_t>,
+ * kept in a treap whose nodes also hold the largest block size of their
+ * subtree. this turns a first-fit search into one O(log n) descent while
+ * keeping the set's contents (and so every address malloc returns) intact.
+ */
+class FreeList {
+private:
+  struct Node {
+    block_t block;
+    uint64_t max_len;
+    uint32_t prio;
+    Node* left;
+    Node* right;
+  };
+
+  Node* root;
+  uint32_t seed;
+
+  uint32_t next_prio();
+  static void update(Node* t);
+  static void split(Node* t, const block_t& key, bool inclusive, Node*& l, Node*& r);
+  static Node* merge(Node* l, Node* r);
+  static void destroy(Node* t);
+
+public:
+  FreeList();
+  ~FreeList();
+  FreeList(const FreeList&) = delete;
+  FreeList& operator=(const FreeList&) = delete;
+
+  bool contains(const block_t& block) const;
+  void insert(const block_t& block);
+  void erase(const block_t& block);
+  bool lower_bound(const block_t& key, block_t& result) const;
+  bool predecessor(const block_t& key, block_t& result) const;
+  bool first_fit(uint64_t size, block_t& result) const;
+};
+
+#endif //SWPP_ASM_INTERPRETER_FREELIST_H
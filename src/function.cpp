@@ -1,33 +1,100 @@
 #include "function.h"
+#include "opcode.h"
 
 
-Function::Function(string _fname, int _nargs):
-fname(std::move(_fname)), nargs(_nargs), first_bb(), bb_map() {}
+Function::Function(string_view _fname, int _nargs):
+fname(_fname), nargs(_nargs), oracle(::is_oracle_function(fname)),
+first_bb_stmt(nullptr), bbs(), bb_map(), clobbers(0), callees(), block_costs() {}
 
-const string & Function::get_fname() const { return fname; }
+string_view Function::get_fname() const { return fname; }
 
 int Function::get_nargs() const { return nargs; }
 
-Stmt* Function::get_first_bb() const {
-  auto it = bb_map.find(first_bb);
-  if (it == bb_map.end())
-    return nullptr;
-  return it->second;
-}
+bool Function::is_oracle_function() const { return oracle; }
 
-void Function::set_first_bb(const string& bb) { first_bb = bb; }
+Stmt* Function::get_first_bb() const { return first_bb_stmt; }
 
-Stmt* Function::get_bb(const string &bbname) const {
+/** the blocks in the order they are defined, the first being the entry */
+const vector<pair<string_view, Stmt*>>& Function::get_bbs() const { return bbs; }
+
+/** bbname must be interned in the program of this function */
+Stmt* Function::get_bb(string_view bbname) const {
   auto it = bb_map.find(bbname);
   if (it == bb_map.end())
     return nullptr;
   return it->second;
 }
 
-bool Function::set_bb(const string &bbname, Stmt *stmt) {
-  auto it = bb_map.find(bbname);
-  if (it != bb_map.end())
+bool Function::set_bb(string_view bbname, Stmt* stmt) {
+  if (!bb_map.emplace(bbname, stmt).second)
     return false;
-  bb_map.insert(pair<string, Stmt*>(bbname, stmt));
+  bbs.emplace_back(bbname, stmt);
   return true;
 }
+
+/** resolve_stmts is false for statements whose targets were set up front */
+void Function::link(const Program& program, bool resolve_stmts) {
+  first_bb_stmt = bbs.empty() ? nullptr : bbs.front().second;
+  for (auto& it: bbs) {
+    for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next()) {
+      if (resolve_stmts)
+        stmt->link(*this, program);
+      clobbers |= stmt->get_clobbered_regs();
+      if (stmt->get_opcode() == Call) {
+        Function* callee = static_cast<StmtCall*>(stmt)->get_callee();
+        if (callee != nullptr)
+          callees.push_back(callee);
+      }
+    }
+  }
+  count_block_costs();
+}
+
+/**
+ * sums up per opcode what every block logs whichever way it runs, on the
+ * machine this function runs on, for its terminator to log at once. calls
+ * are logged on the machine of the callee, so they are left out. a block
+ * always runs to its terminator unless the run fails, and then no logs are
+ * written; costs are whole numbers, so the sums are exact in any order.
+ */
+void Function::count_block_costs() {
+  const Cost& mc = *(oracle ? OracleMachine : NormalMachine).machine_cost;
+  vector<pair<StmtTerminator*, size_t>> terminators;
+  block_costs.clear();
+  for (auto& it: bbs) {
+    int count[LEN_OPCODE] = {};
+    double cost[LEN_OPCODE] = {};
+    Stmt* stmt = it.second;
+    for (; stmt->get_next() != nullptr; stmt = stmt->get_next()) {
+      if (stmt->get_opcode() == Call)
+        continue;
+      count[stmt->get_opcode()]++;
+      cost[stmt->get_opcode()] += fixed_cost_of(stmt, mc);
+    }
+    count[stmt->get_opcode()]++;
+    cost[stmt->get_opcode()] += fixed_cost_of(stmt, mc);
+
+    terminators.emplace_back(static_cast<StmtTerminator*>(stmt), block_costs.size());
+    for (int i = 0; i < LEN_OPCODE; i++) {
+      if (count[i] != 0)
+        block_costs.push_back(BlockCost { (Opcode)i, count[i], cost[i] });
+    }
+  }
+
+  // the terminators point into block_costs only once it is complete
+  for (size_t i = 0; i < terminators.size(); i++) {
+    size_t end = i + 1 < terminators.size() ? terminators[i + 1].second : block_costs.size();
+    terminators[i].first->set_block_costs(block_costs.data() + terminators[i].second, end - terminators[i].second);
+  }
+}
+
+/** registers a call to this function may change, its callees included */
+RegMask Function::get_clobbered_regs() const { return clobbers; }
+
+/** merges the clobbers of the direct callees, and tells whether anything changed */
+bool Function::add_callee_clobbers() {
+  RegMask old = clobbers;
+  for (Function* callee: callees)
+    clobbers |= callee->clobbers;
+  return clobbers != old;
+}
@@ -1,29 +1,48 @@
 #ifndef SWPP_ASM_INTERPRETER_FUNCTION_H
 #define SWPP_ASM_INTERPRETER_FUNCTION_H
 
-#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "stmt.h"
+#include "arena.h"
 
 using namespace std;
 
+class Program;
 
+
+/** placed in the arena of its program like its statements, with its names interned there */
 class Function {
 private:
-  const string fname;
+  const string_view fname;
   const int nargs;
-  string first_bb;
-  map<string, Stmt*> bb_map;
+  const bool oracle;
+  Stmt* first_bb_stmt;
+  vector<pair<string_view, Stmt*>> bbs;
+  unordered_map<string_view, Stmt*, SymbolHash, SymbolEqual> bb_map;
+  RegMask clobbers;
+  vector<Function*> callees;
+  vector<BlockCost> block_costs;
+
+  void count_block_costs();
 
 public:
-  Function(string _fname, int _nargs);
+  Function(string_view _fname, int _nargs);
+  Function(const Function&) = delete;
+  Function& operator=(const Function&) = delete;
 
-  const string& get_fname() const;
+  string_view get_fname() const;
   int get_nargs() const;
+  bool is_oracle_function() const;
   Stmt* get_first_bb() const;
-  void set_first_bb(const string& bb);
-  Stmt* get_bb(const string& bbname) const;
-  bool set_bb(const string& bbname, Stmt* stmt);
+  const vector<pair<string_view, Stmt*>>& get_bbs() const;
+  Stmt* get_bb(string_view bbname) const;
+  bool set_bb(string_view bbname, Stmt* stmt);
+  void link(const Program& program, bool resolve_stmts);
+  RegMask get_clobbered_regs() const;
+  bool add_callee_clobbers();
 };
 
 #endif //SWPP_ASM_INTERPRETER_FUNCTION_H
@@ -0,0 +1,115 @@
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "io.h"
+
+
+GuestIO::GuestIO(int _in_fd, FILE* _out): in_fd(_in_fd), out(_out),
+input_buffer(new char[INPUT_BUFFER_SIZE]), input_pos(0), input_len(0), input_eof(false),
+output_buffer(new char[OUTPUT_BUFFER_SIZE]), output_len(0) {}
+
+GuestIO::~GuestIO() {
+  delete[] input_buffer;
+  delete[] output_buffer;
+}
+
+/** refills the input buffer; false at the end of the input */
+bool GuestIO::fill_input() {
+  if (input_eof)
+    return false;
+
+  // whoever feeds the input may be waiting for what we printed so far
+  flush_output();
+
+  ssize_t n;
+  do {
+    n = read(in_fd, input_buffer, INPUT_BUFFER_SIZE);
+  } while (n < 0 && errno == EINTR);
+
+  if (n <= 0) {
+    input_eof = true;
+    return false;
+  }
+  input_pos = 0;
+  input_len = n;
+  return true;
+}
+
+bool GuestIO::peek_input(char& c) {
+  if (input_pos == input_len && !fill_input())
+    return false;
+  c = input_buffer[input_pos];
+  return true;
+}
+
+/** the characters operator>> on a string skips in the C locale */
+static bool is_input_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool GuestIO::read_input(uint64_t& val) {
+  char c;
+  while (peek_input(c) && is_input_space(c))
+    input_pos++;
+  if (input_pos == input_len)
+    return false;
+
+  bool negative = false;
+  bool sign = c == '+' || c == '-';
+  if (sign) {
+    negative = c == '-';
+    input_pos++;
+  }
+
+  // the whole token is consumed; only the digits right after the sign count
+  uint64_t result = 0;
+  int ndigits = 0;
+  bool in_digits = true;
+  bool overflow = false;
+  while (peek_input(c) && !is_input_space(c)) {
+    input_pos++;
+    if (!in_digits)
+      continue;
+    if (c < '0' || c > '9') {
+      in_digits = false;
+      continue;
+    }
+    uint64_t digit = c - '0';
+    if (result > (UINT64_MAX - digit) / 10)
+      overflow = true;
+    result = result * 10 + digit;
+    ndigits++;
+  }
+
+  if (ndigits == 0 || overflow)
+    return false;
+  val = negative ? -result : result;
+  return true;
+}
+
+void GuestIO::write_output(uint64_t val) {
+  if (output_len + 21 > OUTPUT_BUFFER_SIZE)
+    flush_output();
+
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = (char)('0' + val % 10);
+    val /= 10;
+  } while (val != 0);
+
+  char* p = output_buffer + output_len;
+  while (n > 0)
+    *p++ = digits[--n];
+  *p++ = '\n';
+  output_len = p - output_buffer;
+}
+
+void GuestIO::flush_output() {
+  if (output_len == 0)
+    return;
+  fwrite(output_buffer, 1, output_len, out);
+  fflush(out);
+  output_len = 0;
+}
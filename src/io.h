@@ -0,0 +1,50 @@
+#ifndef SWPP_ASM_INTERPRETER_IO_H
+#define SWPP_ASM_INTERPRETER_IO_H
+
+#include <cinttypes>
+#include <cstdio>
+
+using namespace std;
+
+/** sizes of the guest stdin and stdout buffers */
+#define INPUT_BUFFER_SIZE ((size_t)1 << 20)
+#define OUTPUT_BUFFER_SIZE ((size_t)1 << 16)
+
+
+/** the guest's stdin and stdout, buffered; every run has its own */
+class GuestIO {
+private:
+  int in_fd;
+  FILE* out;
+  char* input_buffer;
+  size_t input_pos;
+  size_t input_len;
+  bool input_eof;
+  char* output_buffer;
+  size_t output_len;
+
+  bool fill_input();
+  bool peek_input(char& c);
+
+public:
+  GuestIO(int _in_fd, FILE* _out);
+  ~GuestIO();
+  GuestIO(const GuestIO&) = delete;
+  GuestIO& operator=(const GuestIO&) = delete;
+
+  /**
+   * reads the next whitespace-separated token of the input as an integer,
+   * with the rules of stoull (an optional sign, then at least one digit;
+   * trailing garbage in the token is ignored). false on a bad token or at
+   * the end of the input.
+   */
+  bool read_input(uint64_t& val);
+
+  /** writes val and a newline to the output, through the output buffer */
+  void write_output(uint64_t val);
+
+  /** must run before anything else is printed to the output, and at the end */
+  void flush_output();
+};
+
+#endif //SWPP_ASM_INTERPRETER_IO_H
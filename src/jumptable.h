@@ -0,0 +1,81 @@
+#ifndef SWPP_ASM_INTERPRETER_JUMPTABLE_H
+#define SWPP_ASM_INTERPRETER_JUMPTABLE_H
+
+#include <cinttypes>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+/** a case range at most this wide always gets a dense table */
+#define JUMP_TABLE_MIN_SPAN ((uint64_t)16)
+
+
+/**
+ * the cases of a switch, resolved to their targets. when the case values
+ * fill at least half of their range, the table is a dense array indexed by
+ * (value - base) with the holes pointing to the default target; otherwise
+ * it is a sorted array of case values searched by bisection.
+ */
+template <typename T>
+class JumpTable {
+private:
+  bool dense;
+  uint64_t base;
+  vector<uint64_t> keys;
+  vector<T> targets;
+  T default_target;
+
+public:
+  JumpTable(): dense(false), base(0), keys(), targets(), default_target() {}
+
+  /** cases (pairs of value and target) must be sorted by value, without duplicates */
+  template <typename Cases>
+  void build(const Cases& cases, T _default_target) {
+    default_target = _default_target;
+    keys.clear();
+    targets.clear();
+    dense = false;
+    if (cases.empty())
+      return;
+
+    uint64_t span = cases[cases.size() - 1].first - cases[0].first;
+    if (span < JUMP_TABLE_MIN_SPAN || span / 2 < cases.size()) {
+      dense = true;
+      base = cases[0].first;
+      targets.assign(span + 1, default_target);
+      for (auto& it: cases)
+        targets[it.first - base] = it.second;
+      return;
+    }
+
+    for (auto& it: cases) {
+      keys.push_back(it.first);
+      targets.push_back(it.second);
+    }
+  }
+
+  T lookup(uint64_t val) const {
+    if (dense) {
+      uint64_t i = val - base;
+      return i < targets.size() ? targets[i] : default_target;
+    }
+    if (keys.empty())
+      return default_target;
+
+    // branch-free bisection: the lookups of a hot switch are rarely predictable
+    const uint64_t* first = keys.data();
+    size_t n = keys.size();
+    while (n > 1) {
+      size_t half = n / 2;
+      first = first[half] < val ? first + half : first;
+      n -= half;
+    }
+    first += *first < val;
+    if (first == keys.data() + keys.size() || *first != val)
+      return default_target;
+    return targets[first - keys.data()];
+  }
+};
+
+#endif //SWPP_ASM_INTERPRETER_JUMPTABLE_H
@@ -0,0 +1,282 @@
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lexer.h"
+
+
+SourceFile::SourceFile(): mapped(nullptr), mapped_len(0), fallback(), contents() {}
+
+SourceFile::~SourceFile() {
+  if (mapped != nullptr)
+    munmap(mapped, mapped_len);
+}
+
+bool SourceFile::open(const string& filename) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st{};
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+      mapped = ptr;
+      mapped_len = st.st_size;
+      contents = string_view((const char*)ptr, mapped_len);
+      close(fd);
+      return true;
+    }
+  }
+  close(fd);
+
+  // not mappable (empty file, pipe, ...): read it the slow way
+  ifstream input(filename, ios::binary);
+  if (!input.is_open())
+    return false;
+  stringstream ss;
+  ss << input.rdbuf();
+  fallback = ss.str();
+  contents = fallback;
+  return true;
+}
+
+string_view SourceFile::get_contents() const { return contents; }
+
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static bool is_digit(char c) {
+  return '0' <= c && c <= '9';
+}
+
+static bool is_name_char(char c) {
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || is_digit(c) ||
+         c == '-' || c == '_' || c == '.';
+}
+
+/** a comment runs up to the first carriage return; only whitespace may follow it */
+static bool is_comment(const char* p, const char* e) {
+  if (p == e || *p != ';')
+    return false;
+  const char* cr = (const char*)memchr(p, '\r', e - p);
+  if (cr == nullptr)
+    return true;
+  for (; cr != e; cr++) {
+    if (!is_space(*cr))
+      return false;
+  }
+  return true;
+}
+
+Lexer::Lexer(string_view src, int first_line): curr(src.data()), end(src.data() + src.size()), line(first_line) {}
+
+bool Lexer::next_line(Tokens& tokens) {
+  tokens.clear();
+  if (curr == end)
+    return false;
+
+  const char* eol = (const char*)memchr(curr, '\n', end - curr);
+  if (eol == nullptr)
+    eol = end;
+  const char* p = curr;
+  curr = eol == end ? end : eol + 1;
+  line++;
+
+  while (p != eol && is_space(*p))
+    p++;
+  if (is_comment(p, eol))
+    return true;
+
+  while (p != eol) {
+    if (is_space(*p)) {
+      p++;
+      continue;
+    }
+    if (*p == '=' || *p == ':') {
+      tokens.emplace_back(p, 1);
+      p++;
+      continue;
+    }
+    const char* start = p;
+    while (p != eol && !is_space(*p) && *p != '=' && *p != ':')
+      p++;
+    tokens.emplace_back(start, p - start);
+  }
+
+  return true;
+}
+
+int Lexer::get_line() const { return line; }
+
+
+static bool token_is(string_view token, const char* str, size_t len) {
+  return memcmp(token.data(), str, len) == 0;
+}
+
+#define MN(STR, MN_KIND) if (token_is(token, STR, sizeof(STR) - 1)) return MN_KIND
+
+Mnemonic lookup_mnemonic(string_view token) {
+  switch (token.size()) {
+    case 2:
+      MN("br", MnBr);
+      MN("or", MnOr);
+      break;
+    case 3:
+      switch (token[0]) {
+        case 'a':
+          MN("add", MnAdd);
+          MN("and", MnAnd);
+          break;
+        case 'e':
+          MN("end", MnEnd);
+          break;
+        case 'm':
+          MN("mul", MnMul);
+          break;
+        case 'r':
+          MN("ret", MnRet);
+          break;
+        case 's':
+          MN("sub", MnSub);
+          MN("shl", MnShl);
+          MN("sum", MnSum);
+          break;
+        case 'x':
+          MN("xor", MnXor);
+          break;
+        default:
+          break;
+      }
+      break;
+    case 4:
+      switch (token[0]) {
+        case 'a':
+          MN("ashr", MnAshr);
+          break;
+        case 'c':
+          MN("call", MnCall);
+          break;
+        case 'd':
+          MN("decr", MnDecr);
+          break;
+        case 'f':
+          MN("free", MnFree);
+          break;
+        case 'i':
+          MN("incr", MnIncr);
+          MN("icmp", MnIcmp);
+          break;
+        case 'l':
+          MN("load", MnLoad);
+          MN("lshr", MnLshr);
+          break;
+        case 's':
+          MN("sdiv", MnSdiv);
+          MN("srem", MnSrem);
+          break;
+        case 'u':
+          MN("udiv", MnUdiv);
+          MN("urem", MnUrem);
+          break;
+        default:
+          break;
+      }
+      break;
+    case 5:
+      MN("start", MnStart);
+      MN("store", MnStore);
+      MN("aload", MnAload);
+      break;
+    case 6:
+      MN("switch", MnSwitch);
+      MN("malloc", MnMalloc);
+      MN("select", MnSelect);
+      break;
+    case 9:
+      MN("assert_eq", MnAssertEq);
+      break;
+    default:
+      break;
+  }
+  return MnNone;
+}
+
+#undef MN
+
+/** matches [1-9] | 1[0-9] | 2[0-9] | 3[0-2] */
+static bool is_reg_num(string_view num, int max) {
+  if (num.empty() || num.size() > 2 || num[0] == '0')
+    return false;
+  int n = 0;
+  for (char c: num) {
+    if (!is_digit(c))
+      return false;
+    n = n * 10 + (c - '0');
+  }
+  return n <= max;
+}
+
+bool is_gpreg(string_view token) {
+  if (token == "sp")
+    return true;
+  return token.size() >= 2 && token[0] == 'r' && is_reg_num(token.substr(1), 32);
+}
+
+bool is_argreg(string_view token) {
+  return token.size() >= 4 && token_is(token, "arg", 3) && is_reg_num(token.substr(3), 16);
+}
+
+bool is_reg(string_view token) {
+  return is_gpreg(token) || is_argreg(token);
+}
+
+bool is_constant(string_view token) {
+  if (token.empty())
+    return false;
+  for (char c: token) {
+    if (!is_digit(c))
+      return false;
+  }
+  return true;
+}
+
+bool is_value(string_view token) {
+  return is_reg(token) || is_constant(token);
+}
+
+bool is_name(string_view token) {
+  if (token.empty())
+    return false;
+  for (char c: token) {
+    if (!is_name_char(c))
+      return false;
+  }
+  return true;
+}
+
+bool is_bbname(string_view token) {
+  return token.size() >= 2 && token[0] == '.' && is_name(token.substr(1));
+}
+
+bool is_argn(string_view token) {
+  if (token.size() == 1)
+    return is_digit(token[0]);
+  return token.size() == 2 && token[0] == '1' && '0' <= token[1] && token[1] <= '6';
+}
+
+bool is_msize(string_view token) {
+  return token == "1" || token == "2" || token == "4" || token == "8";
+}
+
+bool is_size(string_view token) {
+  return token == "1" || token == "8" || token == "16" || token == "32" || token == "64";
+}
@@ -0,0 +1,108 @@
+#ifndef SWPP_ASM_INTERPRETER_LEXER_H
+#define SWPP_ASM_INTERPRETER_LEXER_H
+
+#include <cinttypes>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+
+/** read-only view of a whole source file, memory-mapped when possible */
+class SourceFile {
+private:
+  void* mapped;
+  size_t mapped_len;
+  string fallback;
+  string_view contents;
+
+public:
+  SourceFile();
+  ~SourceFile();
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+
+  bool open(const string& filename);
+  string_view get_contents() const;
+};
+
+
+enum Mnemonic {
+  MnNone = 0,
+  MnStart,
+  MnEnd,
+
+  // terminators
+  MnRet,
+  MnBr,
+  MnSwitch,
+
+  // memory operations
+  MnMalloc,
+  MnFree,
+  MnLoad,
+  MnAload,
+  MnStore,
+
+  // binary operations
+  MnUdiv,
+  MnSdiv,
+  MnUrem,
+  MnSrem,
+  MnMul,
+  MnShl,
+  MnLshr,
+  MnAshr,
+  MnAnd,
+  MnOr,
+  MnXor,
+  MnAdd,
+  MnSub,
+
+  // other operations
+  MnSum,
+  MnIncr,
+  MnDecr,
+  MnIcmp,
+  MnSelect,
+  MnCall,
+  MnAssertEq
+};
+
+typedef vector<string_view> Tokens;
+
+/**
+ * splits a source buffer into lines and each line into tokens.
+ * tokens are separated by whitespace, and '=' and ':' always form tokens
+ * of their own. blank lines and comment lines produce no tokens.
+ */
+class Lexer {
+private:
+  const char* curr;
+  const char* end;
+  int line;
+
+public:
+  /** first_line is the number of lines before src, for a piece of a bigger source */
+  explicit Lexer(string_view src, int first_line = 0);
+
+  bool next_line(Tokens& tokens);
+  int get_line() const;
+};
+
+Mnemonic lookup_mnemonic(string_view token);
+
+bool is_space(char c);
+bool is_gpreg(string_view token);
+bool is_argreg(string_view token);
+bool is_reg(string_view token);
+bool is_constant(string_view token);
+bool is_value(string_view token);
+bool is_name(string_view token);
+bool is_bbname(string_view token);
+bool is_argn(string_view token);
+bool is_msize(string_view token);
+bool is_size(string_view token);
+
+#endif //SWPP_ASM_INTERPRETER_LEXER_H
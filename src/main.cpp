@@ -1,52 +1,135 @@
 #include <iostream>
-#include <fstream>
-#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
 
 #include "parser.h"
+#include "progcache.h"
 #include "state.h"
-#include "error.h"
+#include "batch.h"
+#include "server.h"
+#include "report.h"
 
 using namespace std;
 
 
+void print_usage() {
+  cout << "USAGE: swpp-interpreter [--engine=tree|bytecode] [--max-call-depth=N] [--cost-tree=contexts|calls] "
+          "[--profile[=values]] [--cache[=<dir>]] <input assembly file>" << endl;
+  cout << "       swpp-interpreter --batch [--jobs=N] [--engine=tree|bytecode] [--max-call-depth=N] "
+          "[--cost-tree=contexts|calls] [--profile[=values]] [--cache[=<dir>]] "
+          "<input assembly file> <input directory>" << endl;
+  cout << "       swpp-interpreter --serve=<socket>" << endl;
+}
+
+/** parses the N of a "<option>N" argument */
+bool parse_count(const string& arg, const string& option, size_t& val) {
+  string num = arg.substr(option.size());
+  try {
+    if (num.find_first_not_of("0123456789") != string::npos)
+      throw invalid_argument(num);
+    val = stoull(num);
+  } catch (exception& e) {
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    cout << "USAGE: swpp-interpreter <input assembly file>" << endl;
-    return 1;
+  EngineKind engine = EngineTree;
+  CostTreeKind cost_tree = CostTreeContexts;
+  size_t max_call_depth = DEFAULT_MAX_CALL_DEPTH;
+  ProfileKind profile = ProfileNone;
+  bool batch = false;
+  bool cache = false;
+  string cache_dir;
+  size_t jobs = 0;
+  string serve;
+  string filename;
+  string input_dir;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--engine=tree")
+      engine = EngineTree;
+    else if (arg == "--engine=bytecode")
+      engine = EngineBytecode;
+    else if (arg == "--cost-tree=contexts")
+      cost_tree = CostTreeContexts;
+    else if (arg == "--cost-tree=calls")
+      cost_tree = CostTreeCalls;
+    else if (arg == "--profile")
+      profile = ProfileCosts;
+    else if (arg == "--profile=values")
+      profile = ProfileValues;
+    else if (arg == "--batch")
+      batch = true;
+    else if (arg == "--cache")
+      cache = true;
+    else if (arg.rfind("--cache=", 0) == 0 && arg.size() > strlen("--cache=")) {
+      cache = true;
+      cache_dir = arg.substr(strlen("--cache="));
+    }
+    else if (arg.rfind("--serve=", 0) == 0)
+      serve = arg.substr(strlen("--serve="));
+    else if (arg.rfind("--max-call-depth=", 0) == 0) {
+      if (!parse_count(arg, "--max-call-depth=", max_call_depth)) {
+        print_usage();
+        return 1;
+      }
+    }
+    else if (arg.rfind("--jobs=", 0) == 0) {
+      if (!parse_count(arg, "--jobs=", jobs) || jobs > UINT_MAX) {
+        print_usage();
+        return 1;
+      }
+    }
+    else if (arg.rfind("--", 0) != 0 && filename.empty())
+      filename = arg;
+    else if (arg.rfind("--", 0) != 0 && batch && input_dir.empty())
+      input_dir = arg;
+    else {
+      print_usage();
+      return 1;
+    }
   }
 
-  string filename = argv[1];
-  error_filename = filename;
+  if (!serve.empty()) {
+    if (!filename.empty() || batch || cache || profile != ProfileNone) {
+      print_usage();
+      return 1;
+    }
+    return run_server(serve);
+  }
 
-  Program* program = parse(filename);
-  if (program == nullptr) {
-    cout << "Error: cannot find " << filename << endl;
+  if (filename.empty() || batch == input_dir.empty()) {
+    print_usage();
     return 1;
   }
 
+  Program* program;
+  Status status = cache ? load_program(filename, cache_dir, program) : parse(filename, program);
+  if (!status.ok()) {
+    cout << status.to_string() << endl;
+    return EXIT_FAILURE;
+  }
+
+  if (batch)
+    return run_batch(program, input_dir, BatchOptions { engine, cost_tree, profile, max_call_depth, (unsigned)jobs });
+
   State state;
   state.set_program(program);
-  uint64_t ret = state.exec_program();
-
-  ofstream log("swpp-interpreter.log");
-  double exec_cost = state.get_cost_value();
-  double max_heap_size = state.get_max_alloced_size();
-  log << fixed << setprecision(4);
-  log << "Returned: " << ret << endl;
-  log << "Execution cost: " << exec_cost << endl;
-  log << "Max heap usage (bytes): " << max_heap_size << endl;
-  log << "Total cost: " << exec_cost + max_heap_size * 1024.0 << endl;
-  log.close();
-
-  ofstream cost_log("swpp-interpreter-cost.log");
-  cost_log << fixed << setprecision(4);
-  cost_log << "Total waiting cost: " << state.get_total_wait_cost() << endl;
-  cost_log << state.get_cost()->to_string("");
-  cost_log.close();
-
-  ofstream inst_log("swpp-interpreter-inst.log");
-  inst_log << state.inst_log_to_string();
-  inst_log.close();
+  state.set_engine(engine);
+  state.set_cost_tree(cost_tree);
+  state.set_profile(profile);
+  state.set_max_call_depth(max_call_depth);
+  uint64_t ret;
+  status = state.exec_program(ret);
+  if (!status.ok()) {
+    cout << status.to_string() << endl;
+    return EXIT_FAILURE;
+  }
 
+  write_logs(state, ret, "");
   return 0;
 }
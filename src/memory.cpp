@@ -1,37 +1,116 @@
 #include <cstring>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "error.h"
 #include "opcode.h"
 #include "memory.h"
 
 
+static void* reserve(uint64_t len) {
+  void* ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
 Memory::Memory() {
   memset(stack, 0, STACK_MAX);
   freed.insert(block_t(HEAP_MIN, HEAP_MAX));
   alloced_size = 0;
   max_alloced_size = 0;
+
+  // take the largest reservation the host allows; blocks past it are out of memory
+  heap = nullptr;
+  heap_bits = nullptr;
+  for (heap_limit = HEAP_RESERVE_MAX; heap_limit >= HEAP_RESERVE_MIN; heap_limit /= 2) {
+    heap = (uint8_t*)reserve(heap_limit);
+    heap_bits = (uint64_t*)reserve(heap_limit / 64);
+    if (heap != nullptr && heap_bits != nullptr)
+      return;
+    if (heap != nullptr)
+      munmap(heap, heap_limit);
+    if (heap_bits != nullptr)
+      munmap(heap_bits, heap_limit / 64);
+  }
+  heap = nullptr;
+  heap_bits = nullptr;
+  heap_limit = 0;
 }
 
-alloc_t Memory::find_block(uint64_t addr) const {
-  auto lb = alloced.lower_bound(alloc_t(block_t(addr, -1), nullptr));
+Memory::~Memory() {
+  if (heap != nullptr)
+    munmap(heap, heap_limit);
+  if (heap_bits != nullptr)
+    munmap(heap_bits, heap_limit / 64);
+}
 
-  if (lb == alloced.begin()) {
+/**
+ * translates a heap address. the address is valid when its 8-byte word is
+ * allocated; blocks are 8-byte aligned multiples of 8 bytes, so this is
+ * exactly "some block contains addr".
+ */
+uint8_t* Memory::find_heap(uint64_t addr) const {
+  uint64_t ofs = addr - HEAP_MIN;
+  if (ofs >= heap_limit || ((heap_bits[ofs / 512] >> (ofs / 8 % 64)) & 1) == 0)
     invoke_runtime_error("accessing non-allocated memory");
-  }
+  return heap + ofs;
+}
 
-  lb--;
-  if (lb->first.second <= addr) {
-    invoke_runtime_error("accessing non-allocated memory");
+/** sets or clears the alloced bits of the words in [first, last) */
+static void mark_words(uint64_t* bits, uint64_t first, uint64_t last, bool alloced) {
+  while (first < last) {
+    uint64_t n = min(64 - first % 64, last - first);
+    uint64_t mask = (n == 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1) << (first % 64);
+    if (alloced)
+      bits[first / 64] |= mask;
+    else
+      bits[first / 64] &= ~mask;
+    first += n;
   }
+}
 
-  return *lb;
+/** marks [start, end) allocated; free heap memory is always zero already */
+bool Memory::map_block(uint64_t start, uint64_t end) {
+  if (end - HEAP_MIN > heap_limit)
+    return false;
+  mark_words(heap_bits, (start - HEAP_MIN) / 8, (end - HEAP_MIN) / 8, true);
+  return true;
 }
 
-uint64_t load_little_endian(int size, uint8_t* ptr) {
+/** marks [start, end) free again, and zeroes it for the next malloc */
+void Memory::unmap_block(uint64_t start, uint64_t end) {
+  mark_words(heap_bits, (start - HEAP_MIN) / 8, (end - HEAP_MIN) / 8, false);
+
+  uint8_t* first = heap + (start - HEAP_MIN);
+  uint8_t* last = heap + (end - HEAP_MIN);
+  if (end - start >= HEAP_RELEASE_MIN) {
+    // whole host pages are handed back and come back zero-filled
+    static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    uint8_t* page_first = (uint8_t*)(((uintptr_t)first + page_size - 1) & ~(page_size - 1));
+    uint8_t* page_last = (uint8_t*)((uintptr_t)last & ~(page_size - 1));
+    memset(first, 0, page_first - first);
+    madvise(page_first, page_last - page_first, MADV_DONTNEED);
+    memset(page_last, 0, last - page_last);
+    return;
+  }
+  memset(first, 0, last - first);
+}
+
+/** guest memory is little-endian, which on a little-endian host is a plain access */
+static inline uint64_t load_little_endian(MSize size, const uint8_t* ptr) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  switch (size) {
+    case MSize1: return *ptr;
+    case MSize2: { uint16_t val; memcpy(&val, ptr, 2); return val; }
+    case MSize4: { uint32_t val; memcpy(&val, ptr, 4); return val; }
+    case MSize8: { uint64_t val; memcpy(&val, ptr, 8); return val; }
+  }
+#endif
   uint64_t sum = 0;
-  ptr = ptr + size;
+  int n = msize_of(size);
+  ptr = ptr + n;
 
-  for (int i = 0; i < size; i++) {
+  for (int i = 0; i < n; i++) {
     sum = sum << (uint64_t)8;
     ptr--;
     sum += *ptr;
@@ -40,41 +119,38 @@ uint64_t load_little_endian(int size, uint8_t* ptr) {
   return sum;
 }
 
-uint64_t Memory::load_stack(MSize size, uint64_t addr) const {
-  uint8_t* ptr = (uint8_t*)&stack[0];
-  return load_little_endian(msize_of(size), ptr + addr);
-}
-
-uint64_t Memory::load_heap(MSize size, uint64_t addr) const {
-  alloc_t block = find_block(addr);
-  uint64_t start = block.first.first;
-  uint64_t ofs = addr - start;
-  uint8_t* ptr = block.second + ofs;
-
-  return load_little_endian(msize_of(size), ptr);
-}
-
-void store_little_endian(int size, uint8_t* ptr, uint64_t val) {
+static inline void store_little_endian(MSize size, uint8_t* ptr, uint64_t val) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  switch (size) {
+    case MSize1: *ptr = (uint8_t)val; return;
+    case MSize2: { uint16_t v = val; memcpy(ptr, &v, 2); return; }
+    case MSize4: { uint32_t v = val; memcpy(ptr, &v, 4); return; }
+    case MSize8: memcpy(ptr, &val, 8); return;
+  }
+#endif
   uint64_t mask = 0xFF;
-  for (int i = 0; i < size; i++) {
+  int n = msize_of(size);
+  for (int i = 0; i < n; i++) {
     *ptr = val & mask;
     ptr++;
     val = val >> (uint64_t)8;
   }
 }
 
+uint64_t Memory::load_stack(MSize size, uint64_t addr) const {
+  return load_little_endian(size, stack + addr);
+}
+
+uint64_t Memory::load_heap(MSize size, uint64_t addr) const {
+  return load_little_endian(size, find_heap(addr));
+}
+
 void Memory::store_stack(MSize size, uint64_t addr, uint64_t val) {
-  uint8_t* ptr = (uint8_t*)&stack[0];
-  return store_little_endian(msize_of(size), ptr + addr, val);
+  store_little_endian(size, stack + addr, val);
 }
 
 void Memory::store_heap(MSize size, uint64_t addr, uint64_t val) {
-  alloc_t block = find_block(addr);
-  uint64_t start = block.first.first;
-  uint64_t ofs = addr - start;
-  uint8_t* ptr = block.second + ofs;
-
-  store_little_endian(msize_of(size), ptr, val);
+  store_little_endian(size, find_heap(addr), val);
 }
 
 bool is_stack(MSize size, uint64_t addr) {
@@ -89,8 +165,8 @@ bool is_alligned(MSize size, uint64_t addr) {
   return addr % msize_of(size) == 0;
 }
 
-double Memory::exec_load(bool is_async, MSize size, uint64_t addr, uint64_t& result) {
-  if (is_async && is_oracle()) {
+double Memory::exec_load(const Machine& machine, bool is_async, MSize size, uint64_t addr, uint64_t& result) {
+  if (is_async && machine.machine_kind == Oracle) {
     invoke_runtime_error("async loas inside the oracle");
     return 0;
   }
@@ -102,19 +178,19 @@ double Memory::exec_load(bool is_async, MSize size, uint64_t addr, uint64_t& res
 
   if (is_stack(size, addr)) {
     result = load_stack(size, addr);
-    return is_async ? CurrentMachine->machine_cost->ALOAD : CurrentMachine->machine_cost->STACK;
+    return is_async ? machine.machine_cost->ALOAD : machine.machine_cost->STACK;
   }
 
   if (is_heap(size, addr)) {
     result = load_heap(size, addr);
-    return is_async ? CurrentMachine->machine_cost->ALOAD : CurrentMachine->machine_cost-> HEAP;
+    return is_async ? machine.machine_cost->ALOAD : machine.machine_cost-> HEAP;
   }
 
   invoke_runtime_error("accessing address between 10248 and 20480");
   return 0;
 }
 
-double Memory::exec_store(MSize size, uint64_t addr, uint64_t val) {
+double Memory::exec_store(const Machine& machine, MSize size, uint64_t addr, uint64_t val) {
   if (!is_alligned(size, addr)) {
     invoke_runtime_error("address not aligned");
     return 0;
@@ -122,86 +198,78 @@ double Memory::exec_store(MSize size, uint64_t addr, uint64_t val) {
 
   if (is_stack(size, addr)) {
     store_stack(size, addr, val);
-    return CurrentMachine->machine_cost->STACK;
+    return machine.machine_cost->STACK;
   }
 
   if (is_heap(size, addr)) {
     store_heap(size, addr, val);
-    return CurrentMachine->machine_cost->HEAP;
+    return machine.machine_cost->HEAP;
   }
 
   invoke_runtime_error("acessing address between 10240 and 20480");
   return 0;
 }
 
-double Memory::exec_malloc(uint64_t size, uint64_t& result) {
+double Memory::exec_malloc(const Machine& machine, uint64_t size, uint64_t& result) {
   if (size == 0)
     invoke_runtime_error("allocation size should not be 0");
   if (size % 8 != 0)
     invoke_runtime_error("allocation size should be multiple of 8");
 
-  for (auto it = freed.begin(); it != freed.end(); it++) {
-    if (it->second - it->first < size)
-      continue;
-
-    block_t block = *it;
-    freed.erase(block);
-    freed.insert(block_t(block.first + size, block.second));
-    uint8_t* ptr = (uint8_t*)calloc(size, sizeof(uint8_t));
+  block_t block;
+  if (!freed.first_fit(size, block)) {
+    invoke_runtime_error("out-of-memory");
+    return 0;
+  }
 
-    if (ptr == nullptr) {
-      invoke_runtime_error("out-of-memory");
-      return 0;
-    }
+  freed.erase(block);
+  freed.insert(block_t(block.first + size, block.second));
 
-    alloced.insert(alloc_t(block_t(block.first, block.first + size), ptr));
-    result = block.first;
-    alloced_size += size;
-    if (max_alloced_size < alloced_size)
-      max_alloced_size = alloced_size;
-    return CurrentMachine->machine_cost->MALLOC;
+  if (!map_block(block.first, block.first + size)) {
+    invoke_runtime_error("out-of-memory");
+    return 0;
   }
 
-  invoke_runtime_error("out-of-memory");
-  return 0;
+  alloced.insert(block_t(block.first, block.first + size));
+  result = block.first;
+  alloced_size += size;
+  if (max_alloced_size < alloced_size)
+    max_alloced_size = alloced_size;
+  return machine.machine_cost->MALLOC;
 }
 
-double Memory::exec_free(uint64_t addr) {
-  auto alloc_lb = alloced.lower_bound(alloc_t(block_t(addr, 0), nullptr));
+double Memory::exec_free(const Machine& machine, uint64_t addr) {
+  auto alloc_it = alloced.find(addr);
 
-  if (alloc_lb == alloced.end() || alloc_lb->first.first != addr) {
+  if (alloc_it == alloced.end()) {
     invoke_runtime_error("freeing non-allocated address");
     return 0;
   }
 
-  block_t block = alloc_lb->first;
-  uint8_t* ptr = alloc_lb->second;
+  block_t block = *alloc_it;
   uint64_t size = block.second - block.first;
-  alloced.erase(alloc_lb);
-  free(ptr);
-
-  auto next = freed.lower_bound(block);
-
-  if (next != freed.begin()) {
-    auto prev = next;
-    prev--;
-
-    if (prev->second == block.first) {
-      block = block_t(prev->first, block.second);
-      freed.erase(prev);
-    }
+  alloced.erase(alloc_it);
+  unmap_block(block.first, block.second);
+
+  // same coalescing as on a set<block_t>: the neighbours are taken around
+  // block's position before anything is erased
+  block_t prev, next;
+  bool has_prev = freed.predecessor(block, prev);
+  bool has_next = freed.lower_bound(block, next);
+
+  if (has_prev && prev.second == block.first) {
+    block = block_t(prev.first, block.second);
+    freed.erase(prev);
   }
 
-  if (next != freed.end()) {
-    if (next->first == block.second) {
-      block = block_t(block.first, next->second);
-      freed.erase(next);
-    }
+  if (has_next && next.first == block.second) {
+    block = block_t(block.first, next.second);
+    freed.erase(next);
   }
 
   freed.insert(block);
   alloced_size -= size;
-  return CurrentMachine->machine_cost->FREE;
+  return machine.machine_cost->FREE;
 }
 
 uint64_t Memory::get_alloced_size() const { return alloced_size; }
@@ -3,21 +3,28 @@
 
 #include <cinttypes>
 #include <limits>
-#include <vector>
 #include <map>
-#include <set>
 
 #include "size.h"
+#include "opcode.h"
+#include "freelist.h"
 
 #define STACK_MIN ((uint64_t)0)
 #define STACK_MAX ((uint64_t)102400)
 #define HEAP_MIN ((uint64_t)204800)
 #define HEAP_MAX ((uint64_t)(numeric_limits<uint64_t>::max() - 7))
 
-using namespace std;
+/**
+ * the heap is one reserved host mapping: guest address addr lives at
+ * heap + (addr - HEAP_MIN), and host pages are committed on first touch.
+ * a bitmap over the mapping tells which 8-byte words are allocated.
+ */
+#define HEAP_RESERVE_MAX ((uint64_t)1 << 36)
+#define HEAP_RESERVE_MIN ((uint64_t)1 << 26)
+/** freed blocks at least this large give their host pages back instead of being zeroed */
+#define HEAP_RELEASE_MIN ((uint64_t)1 << 16)
 
-typedef pair<uint64_t, uint64_t> block_t;
-typedef pair<block_t, uint8_t*> alloc_t;
+using namespace std;
 
 bool is_stack(MSize size, uint64_t addr);
 bool is_heap(MSize size, uint64_t addr);
@@ -25,12 +32,17 @@ bool is_heap(MSize size, uint64_t addr);
 class Memory {
 private:
   uint8_t stack[STACK_MAX]{};
-  set<alloc_t> alloced;
-  set<block_t> freed;
+  map<uint64_t, uint64_t> alloced;
+  FreeList freed;
+  uint8_t* heap;
+  uint64_t* heap_bits;
+  uint64_t heap_limit;
   uint64_t alloced_size;
   uint64_t max_alloced_size;
 
-  alloc_t find_block(uint64_t addr) const;
+  uint8_t* find_heap(uint64_t addr) const;
+  bool map_block(uint64_t start, uint64_t end);
+  void unmap_block(uint64_t start, uint64_t end);
   uint64_t load_stack(MSize size, uint64_t addr) const;
   uint64_t load_heap(MSize size, uint64_t addr) const;
   void store_stack(MSize size, uint64_t addr, uint64_t val);
@@ -38,13 +50,16 @@ private:
 
 public:
   Memory();
+  ~Memory();
+  Memory(const Memory&) = delete;
+  Memory& operator=(const Memory&) = delete;
 
   uint64_t get_alloced_size() const;
   uint64_t get_max_alloced_size() const;
-  double exec_load(bool is_async, MSize size, uint64_t addr, uint64_t& result);
-  double exec_store(MSize size, uint64_t addr, uint64_t val);
-  double exec_malloc(uint64_t size, uint64_t& result);
-  double exec_free(uint64_t addr);
+  double exec_load(const Machine& machine, bool is_async, MSize size, uint64_t addr, uint64_t& result);
+  double exec_store(const Machine& machine, MSize size, uint64_t addr, uint64_t val);
+  double exec_malloc(const Machine& machine, uint64_t size, uint64_t& result);
+  double exec_free(const Machine& machine, uint64_t addr);
 };
 
 #endif //SWPP_ASM_INTERPRETER_MEMORY_H
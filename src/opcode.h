@@ -2,6 +2,7 @@
 #define SWPP_ASM_INTERPRETER_OPCODE_H
 
 #include <string>
+#include <string_view>
 
 using namespace std;
 
@@ -133,15 +134,119 @@ enum MachineKind {
 struct Machine {
   // cost of terminators
   MachineKind machine_kind;
-  Cost *machine_cost;
+  const Cost *machine_cost;
 };
 
-extern Machine *CurrentMachine;
-
-void switch_to_normal();
-void switch_to_oracle();
-bool is_normal();
-bool is_oracle();
-bool is_oracle_function(const string& fname);
+/**
+ * the machines are constant; each run keeps track of the one it is on.
+ * they are constexpr so that code instantiated for one machine (see
+ * machine_of) reads its costs as immediates.
+ */
+inline constexpr Cost NormalCost =
+  {
+   // cost of terminators
+   1.0, // RET
+   1.0, // BRUNCOND
+   6.0, // BRCOND_TRUE
+   1.0, // BRCOND_FALSE
+   4.0, // SWITCH
+
+   // cost of memory operations
+   50.0, // MALLOC
+   50.0, // FREE
+   20.0, // STACK
+   30.0, // HEAP
+   1.0, // ALOAD
+   24.0, // WAIT_STACK
+   34.0, // WAIT_HEAP
+
+   // cost of binary operations
+   1.0, // MULDIV
+   4.0, // LOGICAL
+   5.0, // ADDSUB
+
+   // cost of sum operation
+   10.0, // SUM
+
+   // cost of unary operartions
+   1.0, // UOP
+
+   // cost of comparison
+   1.0, // COMP
+
+   // cost of ternary operation
+   1.0, // TERNARY
+
+   // cost of function call
+   2.0, // CALL
+   40.0, // CALL_ORACLE
+   1.0, // PER_ARG
+
+   // cost of assertion
+   0.0, // ASSERT
+  };
+
+inline constexpr Cost OracleCost =
+  {
+   // cost of terminators
+   1.0, // RET
+   1.0, // BRUNCOND
+   6.0, // BRCOND_TRUE
+   1.0, // BRCOND_FALSE
+   4.0, // SWITCH
+
+   // cost of memory operations
+   50.0, // MALLOC
+   50.0, // FREE
+   2.0, // STACK
+   3.0, // HEAP
+   1.0, // ALOAD
+   24.0, // WAIT_STACK
+   34.0, // WAIT_HEAP
+
+   // cost of binary operations
+   1.0, // MULDIV
+   4.0, // LOGICAL
+   5.0, // ADDSUB
+
+   // cost of sum operation
+   10.0, // SUM
+
+   // cost of unary operartions
+   1.0, // UOP
+
+   // cost of comparison
+   1.0, // COMP
+
+   // cost of ternary operation
+   1.0, // TERNARY
+
+   // cost of function call
+   2.0, // CALL
+   40.0, // CALL_ORACLE
+   1.0, // PER_ARG
+
+   // cost of assertion
+   0.0, // ASSERT
+  };
+
+inline constexpr Machine NormalMachine =
+  {
+   Normal, // machine_kind
+   &NormalCost, // machine_cost
+  };
+
+inline constexpr Machine OracleMachine =
+  {
+   Oracle, // machine_kind
+   &OracleCost, // machine_cost
+  };
+
+template <MachineKind M>
+constexpr const Machine& machine_of() {
+  return M == Oracle ? OracleMachine : NormalMachine;
+}
+
+bool is_oracle_function(string_view fname);
 
 #endif //SWPP_ASM_INTERPRETER_OPCODE_H
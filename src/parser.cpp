@@ -1,87 +1,14 @@
-#include <fstream>
-#include <sstream>
 #include <string>
-#include <regex>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_set>
 
 #include "error.h"
+#include "lexer.h"
 #include "parser.h"
 
-#define PAREN(X) ("(" + (X) + ")")
-#define SPACED(X) (PAREN(tESpace + (X) + tESpace))
-
-const static string tSpace = "(\\s+)";
-const static string tESpace = "(\\s*)";
-
-const static string tAssign = SPACED("(=)");
-const static string tGPReg = "(r([1-9]|1[0-9]|2[0-9]|3[0-2])|sp)";
-const static string tArgReg = "(arg([1-9]|1[0-6]))";
-const static string tReg = PAREN(tGPReg + "|" + tArgReg);
-const static string tLhs = tGPReg;
-const static string tConst = "([0-9]+)";
-const static string tValue = PAREN(tReg + "|" + tConst);
-const static string tName = "(([a-z]|[A-Z]|[0-9]|-|_|\\.)+)";
-const static string tBBName = PAREN("\\." + tName);
-
-const static string tArgN = "([0-9]|1[0-6])";
-const static string tMSize = "(1|2|4|8)";
-const static string tSize = "(1|8|16|32|64)";
-
-const static string tStart = "(start)";
-const static string tEnd = "(end)";
-
-const static string tRet = "(ret)";
-const static string tBr = "(br)";
-const static string tSwitch = "(switch)";
-
-const static string tMalloc = "(malloc)";
-const static string tFree = "(free)";
-const static string tLoad = "(load|aload)";
-const static string tStore = "(store)";
-
-const static string tBop = "(udiv|sdiv|urem|srem|mul|shl|lshr|ashr|and|or|xor|add|sub)";
-const static string tSum = "(sum)";
-const static string tUop = "(incr|decr)";
-const static string tIcmp = "(icmp)";
-const static string tCond = "(eq|ne|ugt|uge|ult|ule|sgt|sge|slt|sle)";
-const static string tSelect = "(select)";
-
-const static string tCall = "(call)";
-const static string tAssert = "(assert_eq)";
-
-const static string tRead = "(read)";
-const static string tWrite = "(write)";
-
-const static string rComment = SPACED("(;.*)");
-const static string rStartFuncion = SPACED(tStart + tSpace + tName + tSpace + tArgN + tESpace + "(:)");
-const static string rEndFunction = SPACED(tEnd + tSpace + tName);
-const static string rBBStart = SPACED(tBBName + tESpace + "(:)");
-
-const static string rRet = SPACED(tRet);
-const static string rRetVal = SPACED(tRet + tSpace + tValue);
-const static string rBrUncond = SPACED(tBr + tSpace + tBBName);
-const static string rBrCond = SPACED(tBr + tSpace + tValue + tSpace + tBBName + tSpace + tBBName);
-const static string rTable = "((" + tSpace + tConst + tSpace + tBBName + ")*)";
-const static string rSwitch = SPACED(tSwitch + tSpace + tValue + rTable + tSpace + tBBName);
-
-const static string rMalloc = SPACED(tLhs + tAssign + tMalloc + tSpace + tValue);
-const static string rFree = SPACED(tFree + tSpace + tValue);
-const static string rLoad = SPACED(tLhs + tAssign + tLoad + tSpace + tMSize + tSpace + tValue);
-const static string rStore = SPACED(tStore + tSpace + tMSize + tSpace + tValue + tSpace + tValue);
-
-const static string rBop = SPACED(tLhs + tAssign + tBop + tSpace + tValue + tSpace + tValue + tSpace + tSize);
-const static string rValues8 = PAREN("(" + tSpace + tValue + "){" + to_string(StmtSum::num_operands) + "}");
-const static string rSum = SPACED(tLhs + tAssign + tSum + rValues8 + tSpace + tSize);
-const static string rUop = SPACED(tLhs + tAssign + tUop + tSpace + tValue + tSpace + tSize);
-const static string rIcmp = SPACED(tLhs + tAssign + tIcmp + tSpace + tCond + tSpace + tValue + tSpace + tValue + tSpace + tSize);
-const static string rSelect = SPACED(tLhs + tAssign + tSelect + tSpace + tValue + tSpace + tValue + tSpace + tValue);
-
-const static string rOptAssign = "((" + tLhs + tAssign + ")?)";
-const static string rArgs = "((" + tSpace + tValue + ")*)";
-const static string rRead = SPACED(rOptAssign + tCall + tSpace + tRead);
-const static string rWrite = SPACED(rOptAssign + tCall + tSpace + tWrite + tSpace + tValue);
-const static string rCall = SPACED(rOptAssign + tCall + tSpace + tName + rArgs);
-const static string rAssert = SPACED(tAssert + tSpace + tValue + tSpace + tValue);
-
 
 enum ParserState {
   PSBegin = 0,
@@ -92,42 +19,64 @@ enum ParserState {
   PSEndFunction
 };
 
-Reg parse_reg(const string& reg) {
-  if (regex_match(reg, regex("r.*"))) {
-    int num = stoi(reg.substr(1));
+/** operands of an instruction, i.e. the tokens following its mnemonic */
+struct Operands {
+  const string_view* ops;
+  size_t n;
+
+  string_view operator[](size_t i) const { return ops[i]; }
+};
+
+Reg parse_reg(string_view reg) {
+  if (reg == "sp")
+    return RegSp;
+
+  if (reg[0] == 'r') {
+    int num = 0;
+    for (char c: reg.substr(1))
+      num = num * 10 + (c - '0');
     return (Reg)(num - 1);
   }
 
-  if (regex_match(reg, regex("arg.*"))) {
-    int num = stoi(reg.substr(3));
+  if (reg[0] == 'a') {
+    int num = 0;
+    for (char c: reg.substr(3))
+      num = num * 10 + (c - '0');
     return (Reg)((int)R32 + num);
   }
 
-  if (reg == "sp") {
-    return RegSp;
-  }
-
   return RegNone;
 }
 
-uint64_t parse_const(const string& val) {
-  try {
-    uint64_t ret = stoull(val);
-    return ret;
-  } catch (exception& e) {
-    invoke_syntax_error("constant out of range");
-    return 0;
+uint64_t parse_const(string_view val) {
+  uint64_t ret = 0;
+  for (char c: val) {
+    uint64_t digit = c - '0';
+    if (ret > (UINT64_MAX - digit) / 10) {
+      invoke_syntax_error("constant out of range");
+      return 0;
+    }
+    ret = ret * 10 + digit;
   }
+  return ret;
 }
 
-Value parse_value(const string& val) {
-  if (regex_match(val, regex(tReg)))
+Value parse_value(string_view val) {
+  if (is_reg(val))
     return Value(parse_reg(val));
   else
     return Value(parse_const(val));
 }
 
-MSize parse_msize(const string& msize) {
+/** ops[from, to), placed in the arena of program */
+ArenaArray<Value> parse_values(Program& program, const Operands& ops, size_t from, size_t to) {
+  Value* values = program.get_arena().make_array<Value>(to - from);
+  for (size_t i = from; i < to; i++)
+    new (values + i - from) Value(parse_value(ops[i]));
+  return ArenaArray<Value>(values, to - from);
+}
+
+MSize parse_msize(string_view msize) {
   if (msize == "1") return MSize1;
   if (msize == "2") return MSize2;
   if (msize == "4") return MSize4;
@@ -137,7 +86,7 @@ MSize parse_msize(const string& msize) {
   return MSize1;
 }
 
-Size parse_size(const string& size) {
+Size parse_size(string_view size) {
   if (size == "1") return Size1;
   if (size == "8") return Size8;
   if (size == "16") return Size16;
@@ -148,504 +97,341 @@ Size parse_size(const string& size) {
   return Size1;
 }
 
-Function* parse_start_function(const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+bool parse_cond(string_view cond, BopKind& kind) {
+  if (cond == "eq") kind = Eq;
+  else if (cond == "ne") kind = Ne;
+  else if (cond == "ugt") kind = Ugt;
+  else if (cond == "uge") kind = Uge;
+  else if (cond == "ult") kind = Ult;
+  else if (cond == "ule") kind = Ule;
+  else if (cond == "sgt") kind = Sgt;
+  else if (cond == "sge") kind = Sge;
+  else if (cond == "slt") kind = Slt;
+  else if (cond == "sle") kind = Sle;
+  else return false;
+  return true;
+}
 
-  string fname;
-  int nargs;
+bool all_values(const Operands& ops, size_t from, size_t to) {
+  for (size_t i = from; i < to; i++) {
+    if (!is_value(ops[i]))
+      return false;
+  }
+  return true;
+}
 
-  ss >> token; // start
-  ss >> fname; // fname
-  ss >> token; // nargs
-  nargs = stoi(token);
+bool is_start_function(const Tokens& tokens) {
+  return tokens.size() == 4 && lookup_mnemonic(tokens[0]) == MnStart &&
+         is_name(tokens[1]) && is_argn(tokens[2]) && tokens[3] == ":";
+}
 
-  return new Function(fname, nargs);
+bool is_end_function(const Tokens& tokens) {
+  return tokens.size() == 2 && lookup_mnemonic(tokens[0]) == MnEnd && is_name(tokens[1]);
 }
 
-bool parse_end_function(const string& instr, const string& fname) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+bool is_bb_start(const Tokens& tokens) {
+  return tokens.size() == 2 && is_bbname(tokens[0]) && tokens[1] == ":";
+}
 
-  ss >> token; // end
-  ss >> token; // fname
+/** null if the name is taken, by another function or a built-in */
+Function* parse_start_function(Program& program, const Tokens& tokens) {
+  int nargs = 0;
+  for (char c: tokens[2])
+    nargs = nargs * 10 + (c - '0');
 
-  return token == fname;
+  string_view fname = tokens[1];
+  if (fname == "read" || fname == "write")
+    return nullptr;
+  return program.add_function(fname, nargs);
 }
 
-string parse_bbname(const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+bool parse_end_function(const Tokens& tokens, string_view fname) {
+  return tokens[1] == fname;
+}
 
-  ss >> token; // bbname:
-  return token.substr(0, token.length() - 1);
+string_view parse_bbname(Program& program, const Tokens& tokens) {
+  // the label has always been read as the first whitespace-separated word
+  // with its last character dropped, so ".bb :" names the block ".b"
+  string_view name = tokens[0];
+  bool colon_attached = name.data() + name.size() == tokens[1].data();
+  if (!colon_attached)
+    name.remove_suffix(1);
+  return program.get_symbols().intern(name);
 }
 
-Stmt* parse_ret(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_ret(Program& program, int line, const Operands& ops) {
+  if (ops.n == 0)
+    return program.get_arena().make<StmtRet>(line, Value(0));
+  if (ops.n == 1 && is_value(ops[0]))
+    return program.get_arena().make<StmtRet>(line, parse_value(ops[0]));
+  return nullptr;
+}
 
-  ss >> token; // ret
+Stmt* parse_br(Program& program, int line, const Operands& ops) {
+  if (ops.n == 1 && is_bbname(ops[0]))
+    return program.get_arena().make<StmtBrUncond>(line, program.get_symbols().intern(ops[0]));
 
-  if (ss >> token) {
-    Value val = parse_value(token);
-    return new StmtRet(line, val);
+  if (ops.n == 3 && is_value(ops[0]) && is_bbname(ops[1]) && is_bbname(ops[2])) {
+    Value cond = parse_value(ops[0]);
+    SymbolTable& symbols = program.get_symbols();
+    return program.get_arena().make<StmtBrCond>(line, cond, symbols.intern(ops[1]), symbols.intern(ops[2]));
   }
 
-  return new StmtRet(line, Value(0));
+  return nullptr;
 }
 
-Stmt* parse_br_uncond(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
-
-  ss >> token; // br
-  ss >> token; // bbname
-  string bbname = token;
+Stmt* parse_switch(Program& program, int line, const Operands& ops) {
+  // cond, (const bbname)*, default bbname
+  if (ops.n < 2 || ops.n % 2 != 0 || !is_value(ops[0]) || !is_bbname(ops[ops.n - 1]))
+    return nullptr;
+  for (size_t i = 1; i + 1 < ops.n; i += 2) {
+    if (!is_constant(ops[i]) || !is_bbname(ops[i + 1]))
+      return nullptr;
+  }
 
-  return new StmtBrUncond(line, bbname);
+  Value cond = parse_value(ops[0]);
+  SymbolTable& symbols = program.get_symbols();
+  vector<pair<uint64_t, string_view>> bbs;
+  unordered_set<uint64_t> vals;
+  for (size_t i = 1; i + 1 < ops.n; i += 2) {
+    uint64_t val = parse_const(ops[i]);
+    if (!vals.insert(val).second)
+      invoke_syntax_error("duplicated case in switch statement");
+    bbs.emplace_back(val, symbols.intern(ops[i + 1]));
+  }
+  sort(bbs.begin(), bbs.end());
+
+  Arena& arena = program.get_arena();
+  auto cases = arena.make_array<pair<uint64_t, Stmt*>>(bbs.size());
+  auto case_bbs = arena.make_array<string_view>(bbs.size());
+  for (size_t i = 0; i < bbs.size(); i++) {
+    new (cases + i) pair<uint64_t, Stmt*>(bbs[i].first, nullptr);
+    new (case_bbs + i) string_view(bbs[i].second);
+  }
+  return arena.make<StmtSwitch>(line, cond, ArenaArray<pair<uint64_t, Stmt*>>(cases, bbs.size()), case_bbs,
+                                symbols.intern(ops[ops.n - 1]));
 }
 
-Stmt* parse_br_cond(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
-
-  ss >> token; // br
-  ss >> token; // cond
-  Value cond = parse_value(token);
-  ss >> token; // true_bb
-  string true_bb = token;
-  ss >> token; // false_bb
-  string false_bb = token;
+Stmt* parse_malloc(Program& program, int line, Reg lhs, const Operands& ops) {
+  if (ops.n != 1 || !is_value(ops[0]))
+    return nullptr;
 
-  return new StmtBrCond(line, cond, true_bb, false_bb);
+  return program.get_arena().make<StmtMalloc>(line, lhs, parse_value(ops[0]));
 }
 
-Stmt* parse_switch(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
-
-  ss >> token; // switch
-  ss >> token; // cond
-  Value cond = parse_value(token);
-  auto stmt = new StmtSwitch(line, cond);
-
-  while (true) {
-    string token1, token2;
-    ss >> token1;
-
-    if (ss >> token2) {
-      uint64_t val = parse_const(token1);
-      if (stmt->case_exists(val)) {
-        invoke_syntax_error("duplicated case in switch statement");
-        return nullptr;
-      }
-      stmt->set_bb(val, token2);
-      continue;
-    }
-
-    stmt->set_default(token1);
-    break;
-  }
+Stmt* parse_free(Program& program, int line, const Operands& ops) {
+  if (ops.n != 1 || !is_value(ops[0]))
+    return nullptr;
 
-  return stmt;
+  return program.get_arena().make<StmtFree>(line, parse_value(ops[0]));
 }
 
-Stmt* parse_malloc(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_load(Program& program, int line, Reg lhs, bool is_async, const Operands& ops) {
+  if (ops.n != 2 || !is_msize(ops[0]) || !is_value(ops[1]))
+    return nullptr;
 
-  ss >> token; // lhs
-  Reg lhs = parse_reg(token);
-  ss >> token; // malloc
-  ss >> token; // val
-  Value val = parse_value(token);
+  MSize msize = parse_msize(ops[0]);
+  Value ptr = parse_value(ops[1]);
 
-  return new StmtMalloc(line, lhs, val);
+  return program.get_arena().make<StmtLoad>(line, lhs, is_async, msize, ptr, 0);
 }
 
-Stmt* parse_free(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_store(Program& program, int line, const Operands& ops) {
+  if (ops.n != 3 || !is_msize(ops[0]) || !all_values(ops, 1, 3))
+    return nullptr;
 
-  ss >> token; // malloc
-  ss >> token; // ptr
-  Value ptr = parse_value(token);
+  MSize msize = parse_msize(ops[0]);
+  Value val = parse_value(ops[1]);
+  Value ptr = parse_value(ops[2]);
 
-  return new StmtFree(line, ptr);
+  return program.get_arena().make<StmtStore>(line, msize, val, ptr, 0);
 }
 
-Stmt* parse_load(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_bop(Program& program, int line, Reg lhs, BopKind kind, const Operands& ops) {
+  if (ops.n != 3 || !all_values(ops, 0, 2) || !is_size(ops[2]))
+    return nullptr;
 
-  ss >> token; // lhs
-  Reg lhs = parse_reg(token);
-  ss >> token; // load
-  bool is_async = token == "aload";
-  ss >> token; // size
-  MSize msize = parse_msize(token);
-  ss >> token; // ptr
-  Value ptr = parse_value(token);
+  Value val1 = parse_value(ops[0]);
+  Value val2 = parse_value(ops[1]);
+  Size size = parse_size(ops[2]);
 
-  return new StmtLoad(line, lhs, is_async, msize, ptr, 0);
+  return program.get_arena().make<StmtBop>(line, lhs, kind, val1, val2, size);
 }
 
-Stmt* parse_store(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_sum(Program& program, int line, Reg lhs, const Operands& ops) {
+  const size_t n = StmtSum::num_operands;
+  if (ops.n != n + 1 || !all_values(ops, 0, n) || !is_size(ops[n]))
+    return nullptr;
 
-  ss >> token; // store
-  ss >> token; // size
-  MSize msize = parse_msize(token);
-  ss >> token; // val
-  Value val = parse_value(token);
-  ss >> token; // ptr
-  Value ptr = parse_value(token);
+  ArenaArray<Value> values = parse_values(program, ops, 0, n);
+  Size size = parse_size(ops[n]);
 
-  return new StmtStore(line, msize, val, ptr, 0);
+  return program.get_arena().make<StmtSum>(line, lhs, values, size);
 }
 
-Stmt* parse_bop(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
-
-  ss >> token; // reg
-  Reg lhs = parse_reg(token);
-
-  ss >> token; // bop kind
-  BopKind kind;
-  if (token == "udiv") kind = Udiv;
-  else if (token == "sdiv") kind = Sdiv;
-  else if (token == "urem") kind = Urem;
-  else if (token == "srem") kind = Srem;
-  else if (token == "mul") kind = Mul;
-  else if (token == "shl") kind = Shl;
-  else if (token == "lshr") kind = Lshr;
-  else if (token == "ashr") kind = Ashr;
-  else if (token == "and") kind = And;
-  else if (token == "or") kind = Or;
-  else if (token == "xor") kind = Xor;
-  else if (token == "add") kind = Add;
-  else if (token == "sub") kind = Sub;
-  else {
-    invoke_syntax_error("invalid binary operation");
+Stmt* parse_uop(Program& program, int line, Reg lhs, UopKind uop_kind, const Operands& ops) {
+  if (ops.n != 2 || !is_value(ops[0]) || !is_size(ops[1]))
     return nullptr;
-  }
 
-  ss >> token; // val1
-  Value val1 = parse_value(token);
-  ss >> token; // val2
-  Value val2 = parse_value(token);
-  ss >> token; // bw
-  Size size = parse_size(token);
+  Value val = parse_value(ops[0]);
+  Size size = parse_size(ops[1]);
 
-  return new StmtBop(line, lhs, kind, val1, val2, size);
+  return program.get_arena().make<StmtUop>(line, lhs, uop_kind, val, size);
 }
 
-Stmt* parse_sum(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
-
-  ss >> token; // reg
-  Reg lhs = parse_reg(token);
-  ss >> token; // sum
-
-  vector<Value> values;
-  values.reserve(8);
-  for (int i = 0; i < 8; i++) {
-    ss >> token;
-    values.emplace_back(parse_value(token));
-  }
+Stmt* parse_icmp(Program& program, int line, Reg lhs, const Operands& ops) {
+  BopKind kind;
+  if (ops.n != 4 || !parse_cond(ops[0], kind) || !all_values(ops, 1, 3) || !is_size(ops[3]))
+    return nullptr;
 
-  ss >> token; // bw
-  Size size = parse_size(token);
+  Value val1 = parse_value(ops[1]);
+  Value val2 = parse_value(ops[2]);
+  Size size = parse_size(ops[3]);
 
-  return new StmtSum(line, lhs, values, size);
+  return program.get_arena().make<StmtBop>(line, lhs, kind, val1, val2, size);
 }
 
-Stmt* parse_uop(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_select(Program& program, int line, Reg lhs, const Operands& ops) {
+  if (ops.n != 3 || !all_values(ops, 0, 3))
+    return nullptr;
 
-  ss >> token; // reg
-  Reg lhs = parse_reg(token);
-  ss >> token; // uop
-  UopKind uop_kind = token == "incr" ? Incr : Decr;
-  ss >> token; // val
-  Value val = parse_value(token);
-  ss >> token; // bw
-  Size size = parse_size(token);
+  Value val_cond = parse_value(ops[0]);
+  Value val_true = parse_value(ops[1]);
+  Value val_false = parse_value(ops[2]);
 
-  return new StmtUop(line, lhs, uop_kind, val, size);
+  return program.get_arena().make<StmtSelect>(line, lhs, val_cond, val_true, val_false);
 }
 
-Stmt* parse_icmp(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
-
-  ss >> token; // reg
-  Reg lhs = parse_reg(token);
-  ss >> token; // icmp
-
-  ss >> token; // cond
-  BopKind kind;
-  if (token == "eq") kind = Eq;
-  else if (token == "ne") kind = Ne;
-  else if (token == "ugt") kind = Ugt;
-  else if (token == "uge") kind = Uge;
-  else if (token == "ult") kind = Ult;
-  else if (token == "ule") kind = Ule;
-  else if (token == "sgt") kind = Sgt;
-  else if (token == "sge") kind = Sge;
-  else if (token == "slt") kind = Slt;
-  else if (token == "sle") kind = Sle;
-  else {
-    invoke_syntax_error("invalid comparison");
+Stmt* parse_call(Program& program, int line, Reg lhs, const Operands& ops) {
+  if (ops.n == 0 || !is_name(ops[0]))
     return nullptr;
-  }
-
-  ss >> token; // val1
-  Value val1 = parse_value(token);
-  ss >> token; // val2
-  Value val2 = parse_value(token);
-  ss >> token; // bw
-  Size size = parse_size(token);
-
-  return new StmtBop(line, lhs, kind, val1, val2, size);
-}
-
-Stmt* parse_select(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
-
-  ss >> token; // lhs
-  Reg lhs = parse_reg(token);
-  ss >> token; // select
-  ss >> token; // val_cond
-  Value val_cond = parse_value(token);
-  ss >> token; // val_true
-  Value val_true = parse_value(token);
-  ss >> token; // val_false
-  Value val_false = parse_value(token);
-
-  return new StmtSelect(line, lhs, val_cond, val_true, val_false);
-}
-
-Stmt* parse_call(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
-
-  ss >> token; // reg or call
-  Reg lhs = RegNone;
-  if (regex_match(token, regex(tReg))) {
-    lhs = parse_reg(token);
-    ss >> token; // call
-  }
 
-  ss >> token; // fname
-  string fname = token;
-  auto stmt = new StmtCall(line, lhs, fname);
+  // "read" and "write" are only built-ins when called with the right arity;
+  // otherwise they are ordinary (undefined) functions
+  if (ops[0] == "read" && ops.n == 1)
+    return program.get_arena().make<StmtRead>(line, lhs);
+  if (ops[0] == "write" && ops.n == 2 && is_value(ops[1]))
+    return program.get_arena().make<StmtWrite>(line, lhs, parse_value(ops[1]));
 
-  while (ss >> token) {
-    Value val = parse_value(token);
-    stmt->push_arg(val);
-  }
+  if (!all_values(ops, 1, ops.n))
+    return nullptr;
 
-  return stmt;
+  string_view fname = program.get_symbols().intern(ops[0]);
+  return program.get_arena().make<StmtCall>(line, lhs, fname, parse_values(program, ops, 1, ops.n));
 }
 
-Stmt* parse_assert(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_assert(Program& program, int line, const Operands& ops) {
+  if (ops.n != 2 || !all_values(ops, 0, 2))
+    return nullptr;
 
-  ss >> token; // assert_eq
-  ss >> token; // val1
-  Value val1 = parse_value(token);
-  ss >> token; // val2
-  Value val2 = parse_value(token);
+  Value val1 = parse_value(ops[0]);
+  Value val2 = parse_value(ops[1]);
 
-  return new StmtAssert(line, val1, val2);
+  return program.get_arena().make<StmtAssert>(line, val1, val2);
 }
 
-Stmt* parse_read(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_normal_stmt(Program& program, int line, const Tokens& tokens) {
+  bool has_lhs = tokens.size() >= 2 && tokens[1] == "=";
+  if (has_lhs && !is_gpreg(tokens[0]))
+    return nullptr;
+  Reg lhs = has_lhs ? parse_reg(tokens[0]) : RegNone;
 
-  ss >> token; // reg or call
-  Reg lhs = RegNone;
-  if (regex_match(token, regex(tReg))) {
-    lhs = parse_reg(token);
-    ss >> token; // call
+  size_t mn = has_lhs ? 2 : 0;
+  if (mn >= tokens.size())
+    return nullptr;
+  Operands ops = { tokens.data() + mn + 1, tokens.size() - mn - 1 };
+
+  switch (lookup_mnemonic(tokens[mn])) {
+    case MnMalloc: return has_lhs ? parse_malloc(program, line, lhs, ops) : nullptr;
+    case MnFree: return !has_lhs ? parse_free(program, line, ops) : nullptr;
+    case MnLoad: return has_lhs ? parse_load(program, line, lhs, false, ops) : nullptr;
+    case MnAload: return has_lhs ? parse_load(program, line, lhs, true, ops) : nullptr;
+    case MnStore: return !has_lhs ? parse_store(program, line, ops) : nullptr;
+
+    case MnUdiv: return has_lhs ? parse_bop(program, line, lhs, Udiv, ops) : nullptr;
+    case MnSdiv: return has_lhs ? parse_bop(program, line, lhs, Sdiv, ops) : nullptr;
+    case MnUrem: return has_lhs ? parse_bop(program, line, lhs, Urem, ops) : nullptr;
+    case MnSrem: return has_lhs ? parse_bop(program, line, lhs, Srem, ops) : nullptr;
+    case MnMul: return has_lhs ? parse_bop(program, line, lhs, Mul, ops) : nullptr;
+    case MnShl: return has_lhs ? parse_bop(program, line, lhs, Shl, ops) : nullptr;
+    case MnLshr: return has_lhs ? parse_bop(program, line, lhs, Lshr, ops) : nullptr;
+    case MnAshr: return has_lhs ? parse_bop(program, line, lhs, Ashr, ops) : nullptr;
+    case MnAnd: return has_lhs ? parse_bop(program, line, lhs, And, ops) : nullptr;
+    case MnOr: return has_lhs ? parse_bop(program, line, lhs, Or, ops) : nullptr;
+    case MnXor: return has_lhs ? parse_bop(program, line, lhs, Xor, ops) : nullptr;
+    case MnAdd: return has_lhs ? parse_bop(program, line, lhs, Add, ops) : nullptr;
+    case MnSub: return has_lhs ? parse_bop(program, line, lhs, Sub, ops) : nullptr;
+
+    case MnSum: return has_lhs ? parse_sum(program, line, lhs, ops) : nullptr;
+    case MnIncr: return has_lhs ? parse_uop(program, line, lhs, Incr, ops) : nullptr;
+    case MnDecr: return has_lhs ? parse_uop(program, line, lhs, Decr, ops) : nullptr;
+    case MnIcmp: return has_lhs ? parse_icmp(program, line, lhs, ops) : nullptr;
+    case MnSelect: return has_lhs ? parse_select(program, line, lhs, ops) : nullptr;
+
+    case MnCall: return parse_call(program, line, lhs, ops);
+    case MnAssertEq: return !has_lhs ? parse_assert(program, line, ops) : nullptr;
+
+    default: return nullptr;
   }
-
-  ss >> token; // fname
-  if (token != "read")
-    invoke_syntax_error("call to read function expected");
-
-  return new StmtRead(line, lhs);
 }
 
-Stmt* parse_write(int line, const string& instr) {
-  string rep = regex_replace(instr, regex(tAssign), " ");
-  stringstream ss;
-  string token;
-  ss << rep;
+Stmt* parse_terminator(Program& program, int line, const Tokens& tokens) {
+  if (tokens.empty())
+    return nullptr;
+  Operands ops = { tokens.data() + 1, tokens.size() - 1 };
 
-  ss >> token; // reg or call
-  Reg lhs = RegNone;
-  if (regex_match(token, regex(tReg))) {
-    lhs = parse_reg(token);
-    ss >> token; // call
+  switch (lookup_mnemonic(tokens[0])) {
+    case MnRet: return parse_ret(program, line, ops);
+    case MnBr: return parse_br(program, line, ops);
+    case MnSwitch: return parse_switch(program, line, ops);
+    default: return nullptr;
   }
-
-  ss >> token; // fname
-  if (token != "write")
-    invoke_syntax_error("call to write function expected");
-
-  ss >> token; // val
-  Value val = parse_value(token);
-
-  return new StmtWrite(line, lhs, val);
-}
-
-Stmt* parse_normal_stmt(int line, const string& instr) {
-  if (regex_match(instr, regex(rMalloc)))
-    return parse_malloc(line, instr);
-  if (regex_match(instr, regex(rFree)))
-    return parse_free(line, instr);
-  if (regex_match(instr, regex(rLoad)))
-    return parse_load(line, instr);
-  if (regex_match(instr, regex(rStore)))
-    return parse_store(line, instr);
-
-  if (regex_match(instr, regex(rBop)))
-    return parse_bop(line, instr);
-  if (regex_match(instr, regex(rSum)))
-    return parse_sum(line, instr);
-  if (regex_match(instr, regex(rUop)))
-    return parse_uop(line, instr);
-  if (regex_match(instr, regex(rIcmp)))
-    return parse_icmp(line, instr);
-  if (regex_match(instr, regex(rSelect)))
-    return parse_select(line, instr);
-
-  if (regex_match(instr, regex(rRead)))
-    return parse_read(line, instr);
-  if (regex_match(instr, regex(rWrite)))
-    return parse_write(line, instr);
-  if (regex_match(instr, regex(rCall)))
-    return parse_call(line, instr);
-
-  if (regex_match(instr, regex(rAssert)))
-    return parse_assert(line, instr);
-
-  return nullptr;
 }
 
-Stmt* parse_terminator(int line, const string& instr) {
-  if (regex_match(instr, regex(rRet)))
-    return parse_ret(line, instr);
-  if (regex_match(instr, regex(rRetVal)))
-    return parse_ret(line, instr);
-  if (regex_match(instr, regex(rBrUncond)))
-    return parse_br_uncond(line, instr);
-  if (regex_match(instr, regex(rBrCond)))
-    return parse_br_cond(line, instr);
-  if (regex_match(instr, regex(rSwitch)))
-    return parse_switch(line, instr);
-
-  return nullptr;
-}
-
-Program* parse(const string& filename) {
+/**
+ * fills program with the functions of src, which starts after first_line
+ * lines; line follows the line being parsed, for errors
+ */
+static void parse_lines(string_view src, int first_line, Program* program, int& line) {
   ParserState state = PSBegin;
-  ifstream input(filename);
-
-  if (!input.is_open())
-    return nullptr;
-
-  int line = 0;
-  string instr;
-  regex re(tESpace);
-  auto program = new Program();
+  Lexer lexer(src, first_line);
+  Tokens tokens;
+  tokens.reserve(16);
   Function* curr_function = nullptr;
-  string curr_bb;
+  string_view curr_bb;
   Stmt* prev_stmt;
   Stmt* curr_stmt;
 
-  while (getline(input, instr)) {
-    error_line_num = ++line;
-    if (regex_match(instr, regex(tESpace + "|" + rComment))) {
+  while (lexer.next_line(tokens)) {
+    line = lexer.get_line();
+    if (tokens.empty()) {
       continue;
     }
 
     switch (state) {
       /** start parsing */
       case PSBegin: {
-        if (!regex_match(instr, regex(rStartFuncion)))
+        if (!is_start_function(tokens))
           invoke_syntax_error("start of a function expected");
 
-        curr_function = parse_start_function(instr);
-        string fname = curr_function->get_fname();
-        if (fname == "read" || fname == "write")
+        curr_function = parse_start_function(*program, tokens);
+        if (curr_function == nullptr)
           invoke_syntax_error("duplicated function name");
-
-        program->set_function(fname, curr_function);
         state = PSStartFunction;
         break;
       }
       /** parsed a function start */
       case PSStartFunction: {
-        if (!regex_match(instr, regex(rBBStart)))
+        if (!is_bb_start(tokens))
           invoke_syntax_error("start of a basic block expected");
 
-        curr_bb = parse_bbname(instr);
-        curr_function->set_first_bb(curr_bb);
+        curr_bb = parse_bbname(*program, tokens);
         state = PSStartBB;
         break;
       }
       /** parsed a basic block name */
       case PSStartBB: {
-        curr_stmt = parse_normal_stmt(line, instr);
+        curr_stmt = parse_normal_stmt(*program, line, tokens);
         if (curr_stmt != nullptr) {
           if (!curr_function->set_bb(curr_bb, curr_stmt))
             invoke_syntax_error("duplicated basic block");
@@ -654,7 +440,7 @@ Program* parse(const string& filename) {
           break;
         }
 
-        curr_stmt = parse_terminator(line, instr);
+        curr_stmt = parse_terminator(*program, line, tokens);
         if (curr_stmt != nullptr) {
           curr_function->set_bb(curr_bb, curr_stmt);
           state = PSEndBB;
@@ -666,7 +452,7 @@ Program* parse(const string& filename) {
       }
       /** parsed a non-terminating instruction */
       case PSNormal: {
-        curr_stmt = parse_normal_stmt(line, instr);
+        curr_stmt = parse_normal_stmt(*program, line, tokens);
         if (curr_stmt != nullptr) {
           prev_stmt->set_next(curr_stmt);
           prev_stmt = curr_stmt;
@@ -674,7 +460,7 @@ Program* parse(const string& filename) {
           break;
         }
 
-        curr_stmt = parse_terminator(line, instr);
+        curr_stmt = parse_terminator(*program, line, tokens);
         if (curr_stmt != nullptr) {
           prev_stmt->set_next(curr_stmt);
           state = PSEndBB;
@@ -686,14 +472,14 @@ Program* parse(const string& filename) {
       }
       /** parsed end of basic block */
       case PSEndBB: {
-        if (regex_match(instr, regex(rBBStart))) {
-          curr_bb = parse_bbname(instr);
+        if (is_bb_start(tokens)) {
+          curr_bb = parse_bbname(*program, tokens);
           state = PSStartBB;
           break;
         }
 
-        if (regex_match(instr, regex(rEndFunction))) {
-          if (!parse_end_function(instr, curr_function->get_fname()))
+        if (is_end_function(tokens)) {
+          if (!parse_end_function(tokens, curr_function->get_fname()))
             invoke_syntax_error("unmatching function name");
           state = PSEndFunction;
           break;
@@ -704,12 +490,11 @@ Program* parse(const string& filename) {
       }
       /** parsed end of function */
       case PSEndFunction: {
-        if (!regex_match(instr, regex(rStartFuncion)))
+        if (!is_start_function(tokens))
           invoke_syntax_error("start of a function expected");
 
-        curr_function = parse_start_function(instr);
-        string fname = curr_function->get_fname();
-        if (fname == "read" || fname == "write" || !program->set_function(fname, curr_function))
+        curr_function = parse_start_function(*program, tokens);
+        if (curr_function == nullptr)
           invoke_syntax_error("duplicated function name");
         state = PSStartFunction;
         break;
@@ -717,18 +502,134 @@ Program* parse(const string& filename) {
     }
   }
 
-  input.close();
-
   if (state != PSEndFunction)
     invoke_syntax_error("function not ended");
+}
 
-  error_line_num = 0;
+static void check_main(const Program* program, int& line) {
+  line = 0;
 
   Function* main = program->get_function("main");
   if (main == nullptr)
     invoke_syntax_error("missing main function");
   if (main->get_nargs() != 0)
     invoke_syntax_error("main function should take 0 arguments");
+}
+
+/** whether the line at p starts with the token "start" */
+static bool is_start_line(const char* p, const char* end) {
+  while (p != end && *p != '\n' && is_space(*p))
+    p++;
+  if (end - p < 5 || memcmp(p, "start", 5) != 0)
+    return false;
+  p += 5;
+  return p == end || is_space(*p) || *p == '=' || *p == ':';
+}
+
+/**
+ * where to cut src for parsing it on jobs threads: the offsets of lines
+ * starting a function, with the end of src last. no piece is smaller than
+ * PARSE_CHUNK_SIZE but the last, and there are a few per thread so that
+ * one long function does not hold everyone up.
+ */
+static vector<size_t> split_source(string_view src, unsigned jobs) {
+  vector<size_t> cuts = { 0 };
+  size_t chunk_size = max((size_t)PARSE_CHUNK_SIZE, src.size() / (jobs * 4));
+  const char* begin = src.data();
+  const char* end = begin + src.size();
+  const char* p = begin + chunk_size;
+  while (p < end) {
+    // the start of the next line, then the next function start from there
+    p = (const char*)memchr(p - 1, '\n', end - p + 1);
+    while (p != nullptr && !is_start_line(p + 1, end))
+      p = (const char*)memchr(p + 1, '\n', end - p - 1);
+    if (p == nullptr)
+      break;
+    cuts.push_back(p + 1 - begin);
+    p += 1 + chunk_size;
+  }
+  cuts.push_back(src.size());
+  return cuts;
+}
+
+/**
+ * parses the pieces of src between cuts on jobs threads, each into a
+ * program of its own, and gathers the functions. null if any piece fails
+ * or a function is defined twice: which error comes first, and at which
+ * line, is left to a parse from the start.
+ */
+static Program* parse_chunks(const string& filename, string_view src, const vector<size_t>& cuts, unsigned jobs) {
+  size_t nchunks = cuts.size() - 1;
+  vector<int> first_lines(nchunks);
+  for (size_t i = 0; i < nchunks; i++)
+    first_lines[i] = i == 0 ? 0 : first_lines[i - 1] + count(src.data() + cuts[i - 1], src.data() + cuts[i], '\n');
+
+  vector<Program*> chunks(nchunks, nullptr);
+  atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < nchunks; i = next++) {
+      auto chunk = new Program(filename);
+      int line;
+      try {
+        parse_lines(src.substr(cuts[i], cuts[i + 1] - cuts[i]), first_lines[i], chunk, line);
+      } catch (const Error& e) {
+        delete chunk;
+        chunk = nullptr;
+      }
+      chunks[i] = chunk;
+    }
+  };
+  vector<thread> workers;
+  for (unsigned i = 1; i < jobs; i++)
+    workers.emplace_back(worker);
+  worker();
+  for (auto& it: workers)
+    it.join();
+
+  auto result = new Program(filename);
+  bool ok = true;
+  for (auto chunk: chunks) {
+    ok = ok && chunk != nullptr && result->take_functions(*chunk);
+    delete chunk;
+  }
+  if (!ok) {
+    delete result;
+    return nullptr;
+  }
+  return result;
+}
+
+Status parse(const string& filename, Program*& program) {
+  program = nullptr;
+  SourceFile input;
+  if (!input.open(filename))
+    return Status(ErrorFile, filename, 0, "");
+  return parse_source(filename, input.get_contents(), program);
+}
+
+Status parse_source(const string& filename, string_view src, Program*& program) {
+  program = nullptr;
+  unsigned jobs = thread::hardware_concurrency();
+  Program* result = nullptr;
+  if (jobs > 1 && src.size() >= 2 * PARSE_CHUNK_SIZE) {
+    vector<size_t> cuts = split_source(src, jobs);
+    if (cuts.size() > 2)
+      result = parse_chunks(filename, src, cuts, min(jobs, (unsigned)cuts.size() - 1));
+  }
+
+  int line = 0;
+  try {
+    if (result == nullptr) {
+      result = new Program(filename);
+      parse_lines(src, 0, result, line);
+    }
+    check_main(result, line);
+  } catch (const Error& e) {
+    delete result;
+    return Status(e.get_kind(), filename, line, e.get_message());
+  }
 
-  return program;
+  result->link();
+  program = result;
+  return Status();
 }
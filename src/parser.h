@@ -1,11 +1,27 @@
 #ifndef SWPP_ASM_INTERPRETER_PARSER_H
 #define SWPP_ASM_INTERPRETER_PARSER_H
 
+#include <string_view>
+
 #include "program.h"
+#include "error.h"
 
 using namespace std;
 
+/**
+ * a source is split at function starts into pieces of at least this many
+ * bytes, which are parsed on separate threads
+ */
+#define PARSE_CHUNK_SIZE (1 << 18)
+
 
-Program* parse(const string& filename);
+/**
+ * parses and links filename into program; program is left null on an error.
+ * a big source is parsed on all cores; errors are reported just as a
+ * parse from the first line to the last would.
+ */
+Status parse(const string& filename, Program*& program);
+/** the same for a source already in memory; filename is only used in errors */
+Status parse_source(const string& filename, string_view src, Program*& program);
 
 #endif //SWPP_ASM_INTERPRETER_PARSER_H
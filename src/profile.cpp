@@ -0,0 +1,469 @@
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <unordered_map>
+
+#include "profile.h"
+
+
+/** the value sites of a statement: its switch condition, call arguments, divisor or loaded value */
+static int count_value_sites(const Stmt* stmt) {
+  switch (stmt->get_opcode()) {
+    case Switch:
+    case Load:
+      return 1;
+    case Call:
+      return static_cast<const StmtCall*>(stmt)->get_nargs();
+    case Bop: {
+      BopKind kind = static_cast<const StmtBop*>(stmt)->get_bop_kind();
+      return kind == Udiv || kind == Urem ? 1 : 0;
+    }
+    default:
+      return 0;
+  }
+}
+
+/** what a site of a statement is called in the value profile */
+static string value_site_name(const Stmt* stmt, int operand) {
+  switch (stmt->get_opcode()) {
+    case Switch:
+      return "cond";
+    case Load:
+      return "result";
+    case Call:
+      return "arg" + to_string(operand + 1);
+    default:
+      return "divisor";
+  }
+}
+
+Profile::Profile(const Program& _program, ProfileKind kind):
+program(_program), blocks(), costs(), waits(), taken(), switches(), cases(), values(kind == ProfileValues),
+value_sites(), histograms(), async_pending(0), async_loads(), async_frames(), async_saved(), async_sites(),
+async_uses() {
+  int max_line = 0;
+  size_t ncases = 0, nsites = 0;
+  for (Function* function: program.get_functions()) {
+    for (auto& it: function->get_bbs()) {
+      for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next()) {
+        max_line = max(max_line, stmt->get_line());
+        if (stmt->get_opcode() == Switch)
+          ncases += static_cast<const StmtSwitch*>(stmt)->get_cases().size() + 1;
+        if (values)
+          nsites += count_value_sites(stmt);
+      }
+    }
+  }
+  blocks.resize(max_line + 1);
+  costs.resize(max_line + 1);
+  waits.resize(max_line + 1);
+  taken.resize(max_line + 1);
+  switches.resize(max_line + 1);
+  cases.resize(ncases);
+  async_sites.resize(max_line + 1);
+  if (values) {
+    value_sites.resize(max_line + 1);
+    histograms.resize(nsites);
+  }
+
+  uint64_t* counts = cases.data();
+  size_t site = 0;
+  for (Function* function: program.get_functions()) {
+    for (auto& it: function->get_bbs()) {
+      for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next()) {
+        if (values) {
+          value_sites[stmt->get_line()] = site;
+          site += count_value_sites(stmt);
+        }
+        if (stmt->get_opcode() != Switch)
+          continue;
+        auto sw = static_cast<const StmtSwitch*>(stmt);
+        switches[stmt->get_line()] = make_pair(sw, counts);
+        counts += sw->get_cases().size() + 1;
+      }
+    }
+  }
+}
+
+/** the cases of a switch are sorted by value */
+void Profile::add_case(int line, uint64_t value) {
+  auto& sw = switches[line];
+  auto& sw_cases = sw.first->get_cases();
+  auto it = lower_bound(sw_cases.begin(), sw_cases.end(), value,
+                        [](const pair<uint64_t, Stmt*>& c, uint64_t v) { return c.first < v; });
+  sw.second[it != sw_cases.end() && it->first == value ? it - sw_cases.begin() : sw_cases.size()]++;
+}
+
+const Program& Profile::get_program() const { return program; }
+
+/**
+ * the load in reg was used by the statement at line, or charged a wait there.
+ * a callee sees the loads of its caller in flight, and may wait for them,
+ * but only the frame that issued a load uses it: the callee's registers are
+ * restored on its return.
+ */
+void Profile::use_async(int reg, int line, double use, double wait) {
+  AsyncLoad& load = async_loads[reg];
+  bool first = !load.used && load.depth == (int)async_frames.size();
+  if (!first && wait == 0)
+    return;
+  AsyncSite& site = async_sites[load.line];
+  if (site.last_use == nullptr || site.consumer != line) {
+    site.consumer = line;
+    site.last_use = &async_uses[make_pair(load.line, line)];
+  }
+  AsyncUse& consumer = *site.last_use;
+  if (first) {
+    load.used = true;
+    site.used++;
+    site.distance += use - load.issued;
+    consumer.count++;
+    consumer.distance += use - load.issued;
+  }
+  site.waited[load.heap] += wait;
+  consumer.wait += wait;
+}
+
+/** a load still in reg is used by the aload that replaces it */
+void Profile::issue_async(Reg reg, int line, double use, double issued, double ready, bool heap) {
+  if ((async_pending >> reg) & 1) {
+    if (!async_loads[reg].used)
+      use_async(reg, line, use, 0);
+  }
+  async_loads[reg] = AsyncLoad { line, (int)async_frames.size(), heap, false, issued, ready };
+  async_pending |= reg_mask(reg);
+  AsyncSite& site = async_sites[line];
+  site.issued++;
+  site.latency[heap] += ready - issued;
+}
+
+/**
+ * a wait of a statement ends when the load it waited for is ready, which
+ * tells the load; it may be read and still wait, as a call reads its
+ * arguments. the loads whose registers no longer wait were used here.
+ */
+void Profile::resolve_pending(const RegFile& regfile, int line, double use, double wait) {
+  if (wait > 0) {
+    for (RegMask mask = async_pending; mask != 0; mask &= mask - 1) {
+      int reg = __builtin_ctzll(mask);
+      if (async_loads[reg].ready == use + wait) {
+        use_async(reg, line, use, wait);
+        break;
+      }
+    }
+  }
+  for (RegMask mask = async_pending; mask != 0; mask &= mask - 1) {
+    int reg = __builtin_ctzll(mask);
+    if (regfile.peek_reg((Reg)reg).second < 0) {
+      if (!async_loads[reg].used)
+        use_async(reg, line, use, 0);
+      async_pending &= ~reg_mask((Reg)reg);
+    }
+  }
+}
+
+/**
+ * a call reads its arguments, and saves the registers the callee writes.
+ * the ones among them it also reads are restored resolved, the others as
+ * they were.
+ */
+void Profile::enter_call(int line, double use, RegMask saved, RegMask args) {
+  for (RegMask mask = async_pending & args; mask != 0; mask &= mask - 1) {
+    int reg = __builtin_ctzll(mask);
+    if (!async_loads[reg].used)
+      use_async(reg, line, use, 0);
+  }
+  RegMask kept = async_pending & saved & ~args;
+  for (RegMask mask = kept; mask != 0; mask &= mask - 1)
+    async_saved.push_back(async_loads[__builtin_ctzll(mask)]);
+  async_frames.push_back(kept);
+}
+
+void Profile::leave_call(RegMask saved) {
+  RegMask kept = async_frames.back();
+  async_frames.pop_back();
+  const AsyncLoad* area = async_saved.data() + async_saved.size() - __builtin_popcountll(kept);
+  for (RegMask mask = kept; mask != 0; mask &= mask - 1, area++)
+    async_loads[__builtin_ctzll(mask)] = *area;
+  async_saved.resize(async_saved.size() - __builtin_popcountll(kept));
+  async_pending = (async_pending & ~saved) | kept;
+}
+
+/** a statement or a block, and what the run spent on it */
+struct ProfileEntry {
+  int line;
+  const Function* function;
+  string_view bbname;
+  uint64_t count;
+  double cost;
+  double wait;
+};
+
+/** the statements of the program, and their blocks, with the count of their block and their cost */
+static void collect_entries(const Program& program, const vector<uint64_t>& blocks, const vector<double>& costs,
+                            const vector<double>& waits, vector<ProfileEntry>& lines, vector<ProfileEntry>& bbs) {
+  for (Function* function: program.get_functions()) {
+    const Cost& mc = *(function->is_oracle_function() ? OracleMachine : NormalMachine).machine_cost;
+    for (auto& it: function->get_bbs()) {
+      Stmt* last = it.second;
+      while (last->get_next() != nullptr)
+        last = last->get_next();
+      uint64_t count = blocks[last->get_line()];
+
+      ProfileEntry bb = { it.second->get_line(), function, it.first, count, 0, 0 };
+      for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next()) {
+        int line = stmt->get_line();
+        ProfileEntry entry = { line, function, it.first, count, count * fixed_cost_of(stmt, mc) + costs[line],
+                               waits[line] };
+        bb.cost += entry.cost;
+        bb.wait += entry.wait;
+        lines.push_back(entry);
+      }
+      bbs.push_back(bb);
+    }
+  }
+}
+
+static void write_entries(ostream& out, vector<ProfileEntry>& entries, double total) {
+  sort(entries.begin(), entries.end(), [](const ProfileEntry& a, const ProfileEntry& b) {
+    if (a.cost + a.wait != b.cost + b.wait)
+      return a.cost + a.wait > b.cost + b.wait;
+    return a.line < b.line;
+  });
+  for (auto& entry: entries) {
+    if (entry.count == 0)
+      break;
+    out << entry.line << "\t" << entry.function->get_fname() << "\t" << entry.bbname << "\t" << entry.count << "\t"
+        << entry.cost << "\t" << entry.wait << "\t" << (total == 0 ? 0 : (entry.cost + entry.wait) * 100 / total)
+        << endl;
+  }
+}
+
+/** the name of the block every first statement starts */
+static unordered_map<const Stmt*, string_view> block_names(const Function* function) {
+  unordered_map<const Stmt*, string_view> names;
+  for (auto& it: function->get_bbs())
+    names[it.second] = it.first;
+  return names;
+}
+
+/** a target that is not a block cannot have been taken; it is left unnamed */
+static string_view target_name(const unordered_map<const Stmt*, string_view>& names, const Stmt* target) {
+  auto it = names.find(target);
+  return it == names.end() ? "-" : it->second;
+}
+
+/** a br that went to its true block, the dearer one, more often than to its false block */
+struct MisorientedBranch {
+  int line;
+  const Function* function;
+  string_view bbname;
+  uint64_t taken;
+  uint64_t not_taken;
+  double saving;
+};
+
+/**
+ * a table of the blocks, then one of the lines, that ran, by their cost
+ * and wait together; the share is of the cost of the whole run. last come
+ * the brs whose conditions are worth inverting, by the cost it would save.
+ */
+void Profile::write_report(ostream& out) const {
+  vector<ProfileEntry> lines, bbs;
+  collect_entries(program, blocks, costs, waits, lines, bbs);
+  double total = 0;
+  for (auto& bb: bbs)
+    total += bb.cost + bb.wait;
+
+  vector<MisorientedBranch> branches;
+  for (Function* function: program.get_functions()) {
+    const Cost& mc = *(function->is_oracle_function() ? OracleMachine : NormalMachine).machine_cost;
+    for (auto& it: function->get_bbs()) {
+      for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next()) {
+        if (stmt->get_opcode() != BrCond)
+          continue;
+        int line = stmt->get_line();
+        uint64_t not_taken = blocks[line] - taken[line];
+        double saving = ((double)taken[line] - (double)not_taken) * (mc.BRCOND_TRUE - mc.BRCOND_FALSE);
+        if (saving > 0)
+          branches.push_back({ line, function, it.first, taken[line], not_taken, saving });
+      }
+    }
+  }
+  sort(branches.begin(), branches.end(), [](const MisorientedBranch& a, const MisorientedBranch& b) {
+    if (a.saving != b.saving)
+      return a.saving > b.saving;
+    return a.line < b.line;
+  });
+
+  out << fixed << setprecision(4);
+  out << "Blocks by cost" << endl;
+  out << "Line" << "\t" << "Function" << "\t" << "Block" << "\t" << "Count" << "\t" << "Cost" << "\t" << "Wait" << "\t"
+      << "Share(%)" << endl;
+  write_entries(out, bbs, total);
+  out << endl;
+  out << "Lines by cost" << endl;
+  out << "Line" << "\t" << "Function" << "\t" << "Block" << "\t" << "Count" << "\t" << "Cost" << "\t" << "Wait" << "\t"
+      << "Share(%)" << endl;
+  write_entries(out, lines, total);
+  out << endl;
+  out << "Mis-oriented branches" << endl;
+  out << "Line" << "\t" << "Function" << "\t" << "Block" << "\t" << "True" << "\t" << "False" << "\t" << "Saving"
+      << "\t" << "Share(%)" << endl;
+  for (auto& branch: branches) {
+    out << branch.line << "\t" << branch.function->get_fname() << "\t" << branch.bbname << "\t" << branch.taken << "\t"
+        << branch.not_taken << "\t" << branch.saving << "\t" << (total == 0 ? 0 : branch.saving * 100 / total) << endl;
+  }
+
+  vector<const Function*> functions(blocks.size(), nullptr);
+  for (auto& entry: lines)
+    functions[entry.line] = entry.function;
+  write_async(out, functions);
+}
+
+/**
+ * the latency of the async loads of the run, and how much of it their
+ * uses waited for, then the same by site, then the uses of every site by
+ * statement, those that waited most first. distances are averages.
+ */
+void Profile::write_async(ostream& out, const vector<const Function*>& functions) const {
+  double latency[2] = { 0, 0 }, waited[2] = { 0, 0 };
+  for (auto& site: async_sites) {
+    for (int heap = 0; heap < 2; heap++) {
+      latency[heap] += site.latency[heap];
+      waited[heap] += site.waited[heap];
+    }
+  }
+  auto hidden_share = [](double latency, double waited) { return latency == 0 ? 0 : (latency - waited) * 100 / latency; };
+
+  out << endl;
+  out << "Async latency" << endl;
+  out << "Wait" << "\t" << "Latency" << "\t" << "Waited" << "\t" << "Hidden(%)" << endl;
+  const char* names[2] = { "WAIT_STACK", "WAIT_HEAP" };
+  for (int heap = 0; heap < 2; heap++)
+    out << names[heap] << "\t" << latency[heap] << "\t" << waited[heap] << "\t" << hidden_share(latency[heap], waited[heap]) << endl;
+
+  out << endl;
+  out << "Async loads" << endl;
+  out << "Line" << "\t" << "Function" << "\t" << "Issued" << "\t" << "Used" << "\t" << "Distance" << "\t" << "Latency"
+      << "\t" << "Waited" << "\t" << "Hidden(%)" << endl;
+  for (size_t line = 0; line < async_sites.size(); line++) {
+    const AsyncSite& site = async_sites[line];
+    if (site.issued == 0)
+      continue;
+    double site_latency = site.latency[0] + site.latency[1], site_waited = site.waited[0] + site.waited[1];
+    out << line << "\t" << functions[line]->get_fname() << "\t" << site.issued << "\t" << site.used << "\t"
+        << (site.used == 0 ? 0 : site.distance / site.used) << "\t" << site_latency << "\t" << site_waited << "\t"
+        << hidden_share(site_latency, site_waited) << endl;
+  }
+
+  vector<pair<pair<int, int>, AsyncUse>> uses(async_uses.begin(), async_uses.end());
+  stable_sort(uses.begin(), uses.end(), [](const pair<pair<int, int>, AsyncUse>& a, const pair<pair<int, int>, AsyncUse>& b) {
+    return a.second.wait > b.second.wait;
+  });
+  out << endl;
+  out << "Async uses" << endl;
+  out << "Site" << "\t" << "Line" << "\t" << "Function" << "\t" << "Uses" << "\t" << "Distance" << "\t" << "Waited" << endl;
+  for (auto& it: uses) {
+    const AsyncUse& use = it.second;
+    out << it.first.first << "\t" << it.first.second << "\t" << functions[it.first.second]->get_fname() << "\t" << use.count
+        << "\t" << (use.count == 0 ? 0 : use.distance / use.count) << "\t" << use.wait << endl;
+  }
+}
+
+/**
+ * rows are in the order of the source, and name their edge "true" or
+ * "false" for a br, and the case value or "default" for a switch. edges
+ * that were never taken are listed too.
+ */
+void Profile::write_edges(ostream& out) const {
+  out << "Line" << "\t" << "Function" << "\t" << "Block" << "\t" << "Edge" << "\t" << "Target" << "\t" << "Count" << endl;
+  for (Function* function: program.get_functions()) {
+    auto names = block_names(function);
+    for (auto& it: function->get_bbs()) {
+      for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next()) {
+        int line = stmt->get_line();
+        string prefix = to_string(line) + "\t" + string(function->get_fname()) + "\t" + string(it.first) + "\t";
+        if (stmt->get_opcode() == BrCond) {
+          auto br = static_cast<const StmtBrCond*>(stmt);
+          out << prefix << "true" << "\t" << target_name(names, br->get_true_bb()) << "\t" << taken[line] << endl;
+          out << prefix << "false" << "\t" << target_name(names, br->get_false_bb()) << "\t" << blocks[line] - taken[line]
+              << endl;
+        } else if (stmt->get_opcode() == Switch) {
+          auto sw = switches[line];
+          auto& sw_cases = sw.first->get_cases();
+          for (size_t i = 0; i < sw_cases.size(); i++) {
+            out << prefix << sw_cases[i].first << "\t" << target_name(names, sw_cases[i].second) << "\t" << sw.second[i]
+                << endl;
+          }
+          out << prefix << "default" << "\t" << target_name(names, sw.first->get_default_bb()) << "\t"
+              << sw.second[sw_cases.size()] << endl;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * the annotations are comments above their statements, indented alike, so
+ * the copy is still a program (with its lines moved down)
+ */
+void Profile::write_annotated(ostream& out, istream& source) const {
+  vector<ProfileEntry> lines, bbs;
+  collect_entries(program, blocks, costs, waits, lines, bbs);
+  vector<const ProfileEntry*> by_line(blocks.size(), nullptr);
+  for (auto& entry: lines)
+    by_line[entry.line] = &entry;
+
+  out << fixed << setprecision(4);
+  string text;
+  for (int line = 1; getline(source, text); line++) {
+    const ProfileEntry* entry = line < (int)by_line.size() ? by_line[line] : nullptr;
+    if (entry != nullptr) {
+      out << text.substr(0, text.find_first_not_of(" \t"));
+      if (entry->count == 0)
+        out << "; not run" << "\n";
+      else
+        out << "; count " << entry->count << ", cost " << entry->cost << ", wait " << entry->wait << "\n";
+    }
+    out << text << "\n";
+  }
+}
+
+/**
+ * rows are in the order of the source, then of the sites of a statement,
+ * then of the counts of their values, the highest first. count - error is
+ * how often the value was seen at least; a site with an error of 0 on every
+ * value saw no more distinct values than it has slots, and its counts are
+ * exact. sites that were never reached are left out.
+ */
+void Profile::write_values(ostream& out) const {
+  out << "Line" << "\t" << "Function" << "\t" << "Operand" << "\t" << "Total" << "\t" << "Value" << "\t" << "Count"
+      << "\t" << "Error" << endl;
+  for (Function* function: program.get_functions()) {
+    for (auto& it: function->get_bbs()) {
+      for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next()) {
+        int line = stmt->get_line();
+        for (int operand = 0; operand < count_value_sites(stmt); operand++) {
+          const ValueHistogram& histogram = histograms[value_sites[line] + operand];
+          int order[VALUE_HISTOGRAM_SIZE];
+          uint64_t total = 0;
+          for (int i = 0; i < VALUE_HISTOGRAM_SIZE; i++) {
+            order[i] = i;
+            total += histogram.counts[i];
+          }
+          if (total == 0)
+            continue;
+          stable_sort(order, order + VALUE_HISTOGRAM_SIZE,
+                      [&histogram](int a, int b) { return histogram.counts[a] > histogram.counts[b]; });
+          for (int i: order) {
+            if (histogram.counts[i] == 0)
+              break;
+            out << line << "\t" << function->get_fname() << "\t" << value_site_name(stmt, operand) << "\t" << total
+                << "\t" << histogram.values[i] << "\t" << histogram.counts[i] << "\t" << histogram.errors[i] << endl;
+          }
+        }
+      }
+    }
+  }
+}
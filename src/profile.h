@@ -0,0 +1,200 @@
+#ifndef SWPP_ASM_INTERPRETER_PROFILE_H
+#define SWPP_ASM_INTERPRETER_PROFILE_H
+
+#include <cinttypes>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <vector>
+
+#include "program.h"
+
+using namespace std;
+
+/** the slots of a value histogram: one cache line of values, one of counts, one of errors */
+#define VALUE_HISTOGRAM_SIZE 8
+
+
+/** what a run profiles: nothing, its costs, or its costs and the values at some sites */
+enum ProfileKind {
+  ProfileNone = 0,
+  ProfileCosts,
+  ProfileValues
+};
+
+/**
+ * the most frequent values seen at a site, in a fixed number of slots
+ * (the space-saving algorithm). a value without a slot takes over the one
+ * counted least, and its count; the count it took over is its error, so a
+ * value was seen between count - error and count times. the counts add up
+ * to the number of values seen. empty slots hold a 0 counted 0 times, which
+ * a 0 takes as its own.
+ */
+struct alignas(64) ValueHistogram {
+  uint64_t values[VALUE_HISTOGRAM_SIZE];
+  uint64_t counts[VALUE_HISTOGRAM_SIZE];
+  uint64_t errors[VALUE_HISTOGRAM_SIZE];
+
+  void add(uint64_t value);
+};
+
+
+/** an async load in flight, by the register it loads into */
+struct AsyncLoad {
+  int line;
+  /** the number of calls it was issued under; costs are only comparable within its frame */
+  int depth;
+  bool heap;
+  bool used;
+  double issued;
+  double ready;
+};
+
+/** the loads of a site a statement used first, and the waits it charged to them */
+struct AsyncUse {
+  uint64_t count;
+  double distance;
+  double wait;
+};
+
+/** the async loads of a site: their latency and the part of it waited for, on the stack and on the heap */
+struct AsyncSite {
+  uint64_t issued;
+  uint64_t used;
+  double distance;
+  double latency[2];
+  double waited[2];
+  /** the statement that used the last load, and its AsyncUse, as a site mostly has the same one */
+  int consumer;
+  AsyncUse* last_use;
+};
+
+
+/**
+ * where a run spends its cost, by source line and basic block. the engines
+ * only count how often each block runs, by the line of its terminator, and
+ * add up per line what depends on the run: waits, and the cost of loads,
+ * stores, branches and calls. the rest is the fixed cost of a statement
+ * times the count of its block, and is worked out in the report.
+ *
+ * the edges out of a block are counted too: how often a br went to its
+ * true block (the rest of its count went to the false one), and how often
+ * a switch went to each case, found by value, and to its default.
+ *
+ * profiling values, every site gets a ValueHistogram: the condition of a
+ * switch, each argument of a call, the divisor of a udiv or urem and the
+ * result of a load.
+ *
+ * the async loads in flight are followed by register, as the register file
+ * holds them, and saved and restored with it around calls. a load is used
+ * by the first statement of its function that reads it, or that a register
+ * stops waiting after, and its issue-to-use distance is the cost run in
+ * between. a wait
+ * goes to the load it waited for, the one ready when the wait ends, and the
+ * rest of the latency of every load (WAIT_STACK or WAIT_HEAP) was hidden.
+ */
+class Profile {
+private:
+  const Program& program;
+  vector<uint64_t> blocks;
+  vector<double> costs;
+  vector<double> waits;
+  vector<uint64_t> taken;
+  /** by line, a switch and the counts of its cases, then of its default (in cases) */
+  vector<pair<const StmtSwitch*, uint64_t*>> switches;
+  vector<uint64_t> cases;
+  bool values;
+  /** by line, the histogram of the first site of the statement, if it has any */
+  vector<size_t> value_sites;
+  vector<ValueHistogram> histograms;
+  RegMask async_pending;
+  AsyncLoad async_loads[NREGS];
+  /** the loads in the registers each call saves, in register order, to restore on its return */
+  vector<RegMask> async_frames;
+  vector<AsyncLoad> async_saved;
+  /** by line of the aload */
+  vector<AsyncSite> async_sites;
+  /** by site and consumer */
+  map<pair<int, int>, AsyncUse> async_uses;
+
+  void use_async(int reg, int line, double use, double wait);
+  void resolve_pending(const RegFile& regfile, int line, double use, double wait);
+  /** functions is the function of every line */
+  void write_async(ostream& out, const vector<const Function*>& functions) const;
+
+public:
+  Profile(const Program& _program, ProfileKind kind);
+  Profile(const Profile&) = delete;
+  Profile& operator=(const Profile&) = delete;
+
+  void add_block(int line);
+  void add_cost(int line, double cost);
+  void add_wait(int line, double wait);
+  void add_taken(int line);
+  void add_case(int line, uint64_t value);
+  bool counts_values() const;
+  /** operand is the number of the site within the statement, e.g. of the argument */
+  void add_value(int line, int operand, uint64_t value);
+  /**
+   * what a statement did to async loads: use is the cost when it started,
+   * and wait what it charged. an aload is issued after it is resolved.
+   */
+  void issue_async(Reg reg, int line, double use, double issued, double ready, bool heap);
+  void resolve_async(const RegFile& regfile, int line, double use, double wait);
+  void enter_call(int line, double use, RegMask saved, RegMask args);
+  void leave_call(RegMask saved);
+  const Program& get_program() const;
+  /** the blocks and the lines that ran, the most costly first */
+  void write_report(ostream& out) const;
+  /** source, with the count, cost and wait of each statement in front of its line */
+  void write_annotated(ostream& out, istream& source) const;
+  /** every edge out of a br or a switch, and how often it was taken, one per row */
+  void write_edges(ostream& out) const;
+  /** every site that was reached, and its most frequent values, one per row */
+  void write_values(ostream& out) const;
+};
+
+
+/** called on every block, or every instruction, of a profiled run */
+
+inline void Profile::add_block(int line) { blocks[line]++; }
+
+inline void Profile::add_cost(int line, double cost) { costs[line] += cost; }
+
+inline void Profile::add_wait(int line, double wait) {
+  if (wait != 0)
+    waits[line] += wait;
+}
+
+inline void Profile::add_taken(int line) { taken[line]++; }
+
+inline bool Profile::counts_values() const { return values; }
+
+/** a statement can only wait, or use a load, while one is in flight */
+inline void Profile::resolve_async(const RegFile& regfile, int line, double use, double wait) {
+  if (async_pending != 0)
+    resolve_pending(regfile, line, use, wait);
+}
+
+inline void Profile::add_value(int line, int operand, uint64_t value) {
+  histograms[value_sites[line] + operand].add(value);
+}
+
+inline void ValueHistogram::add(uint64_t value) {
+  for (int i = 0; i < VALUE_HISTOGRAM_SIZE; i++) {
+    if (values[i] == value) {
+      counts[i]++;
+      return;
+    }
+  }
+  int min = 0;
+  for (int i = 1; i < VALUE_HISTOGRAM_SIZE; i++) {
+    if (counts[i] < counts[min])
+      min = i;
+  }
+  values[min] = value;
+  errors[min] = counts[min];
+  counts[min]++;
+}
+
+#endif //SWPP_ASM_INTERPRETER_PROFILE_H
@@ -0,0 +1,705 @@
+#include <cstring>
+#include <cstdio>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "progcache.h"
+#include "parser.h"
+#include "lexer.h"
+
+
+/**
+ * an image is a header followed by six arrays: the functions, their
+ * blocks, their statements, the operands that do not fit in a statement
+ * record, the constants, and the strings. functions and blocks are in the
+ * order they are defined in, the entry block of a function first. block and
+ * target indices count from the first block and statement of their function.
+ * the header keeps a hash of everything after it, so that an image damaged
+ * on disk is parsed anew rather than run.
+ */
+#define IMAGE_MAGIC "SWPPIMG"
+#define IMAGE_VERSION 3
+#define IMAGE_NONE UINT32_MAX
+/** an operand with this bit set is an index into the constants, otherwise a Reg */
+#define IMAGE_CONSTANT 0x80000000u
+
+struct ImageHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t nfunctions;
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint32_t nblocks;
+  uint32_t nstmts;
+  uint32_t noperands;
+  uint32_t nconstants;
+  uint32_t strings_size;
+  uint32_t reserved;
+  uint64_t body_hash;
+};
+
+struct ImageFunction {
+  uint32_t name;
+  uint32_t name_len;
+  uint32_t nargs;
+  uint32_t reserved;
+  uint32_t first_block;
+  uint32_t nblocks;
+  uint32_t first_stmt;
+  uint32_t nstmts;
+};
+
+struct ImageBlock {
+  uint32_t name;
+  uint32_t name_len;
+  uint32_t first_stmt;
+  uint32_t nstmts;
+};
+
+/**
+ * a statement. a, b and c are by opcode:
+ *   br:      a = target
+ *   br cond: a = true target, b = false target
+ *   switch:  a = default target, b .. b + c = cases (in operands, sorted)
+ *   sum:     b .. b + c = values (in operands)
+ *   call:    a = callee (IMAGE_NONE if undefined), b .. b + c = arguments
+ *            (in operands); the name is the string at ops[0] with length
+ *            ops[1]
+ * the offset of a load or store is the operand after its values.
+ */
+struct ImageStmt {
+  uint8_t opcode;
+  uint8_t lhs;
+  uint8_t kind;
+  uint8_t size;
+  int32_t line;
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  uint32_t ops[3];
+};
+
+/** the target is only used by switch cases */
+struct ImageOperand {
+  uint32_t op;
+  uint32_t target;
+};
+
+
+/** not a cryptographic hash, only good enough to tell sources apart and to catch a damaged image */
+static uint64_t hash_bytes(string_view src) {
+  uint64_t hash = 14695981039346656037ull ^ src.size();
+  size_t i = 0;
+  for (; i + 8 <= src.size(); i += 8) {
+    uint64_t word;
+    memcpy(&word, src.data() + i, sizeof(word));
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+    hash ^= hash >> 29;
+  }
+  for (; i < src.size(); i++)
+    hash = (hash ^ (uint8_t)src[i]) * 1099511628211ull;
+  return hash ^ (hash >> 32);
+}
+
+static string image_path(const string& filename, const string& cache_dir, uint64_t source_hash) {
+  if (cache_dir.empty())
+    return filename + PROGRAM_IMAGE_SUFFIX;
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)source_hash);
+  return cache_dir + "/" + name + PROGRAM_IMAGE_SUFFIX;
+}
+
+
+/** writing an image */
+
+class ImageWriter {
+private:
+  vector<ImageFunction> functions;
+  vector<ImageBlock> blocks;
+  vector<ImageStmt> stmts;
+  vector<ImageOperand> operands;
+  vector<uint64_t> constants;
+  string strings;
+  unordered_map<uint64_t, uint32_t> constant_index;
+  unordered_map<string_view, uint32_t> string_ofs;
+  unordered_map<const Function*, uint32_t> function_index;
+  unordered_map<const Stmt*, uint32_t> stmt_index;
+
+  uint32_t add_string(string_view str);
+  uint32_t add_constant(uint64_t val);
+  uint32_t target_of(const Stmt* stmt) const;
+  uint32_t operand_of(const Value& val);
+  ImageStmt stmt_of(const Stmt* stmt);
+  void add_function(const Function* function);
+
+public:
+  explicit ImageWriter(const Program& program);
+
+  bool write(const string& path, uint64_t source_hash, uint64_t source_size) const;
+};
+
+/** str must outlive the writer, as the names of the program do */
+uint32_t ImageWriter::add_string(string_view str) {
+  auto it = string_ofs.find(str);
+  if (it != string_ofs.end())
+    return it->second;
+  uint32_t ofs = strings.size();
+  strings += str;
+  string_ofs.emplace(str, ofs);
+  return ofs;
+}
+
+uint32_t ImageWriter::add_constant(uint64_t val) {
+  auto it = constant_index.find(val);
+  if (it != constant_index.end())
+    return it->second;
+  uint32_t op = constants.size() | IMAGE_CONSTANT;
+  constants.push_back(val);
+  constant_index.emplace(val, op);
+  return op;
+}
+
+uint32_t ImageWriter::target_of(const Stmt* stmt) const {
+  return stmt == nullptr ? IMAGE_NONE : stmt_index.at(stmt);
+}
+
+uint32_t ImageWriter::operand_of(const Value& val) {
+  return val.is_reg() ? (uint32_t)val.get_reg() : add_constant(val.get_literal());
+}
+
+ImageStmt ImageWriter::stmt_of(const Stmt* stmt) {
+  ImageStmt rec{};
+  rec.opcode = stmt->get_opcode();
+  rec.lhs = stmt->get_lhs();
+  rec.line = stmt->get_line();
+  rec.a = rec.b = IMAGE_NONE;
+  auto set_operand = [&](int i, const Value& val) { rec.ops[i] = operand_of(val); };
+  auto set_operands = [&](const ArenaArray<Value>& vals) {
+    rec.b = operands.size();
+    rec.c = vals.size();
+    for (auto& it: vals)
+      operands.push_back(ImageOperand { operand_of(it), IMAGE_NONE });
+  };
+
+  switch (stmt->get_opcode()) {
+    case Ret: set_operand(0, static_cast<const StmtRet*>(stmt)->get_val()); break;
+    case BrUncond: rec.a = target_of(static_cast<const StmtBrUncond*>(stmt)->get_bb()); break;
+    case BrCond: {
+      auto s = static_cast<const StmtBrCond*>(stmt);
+      set_operand(0, s->get_cond());
+      rec.a = target_of(s->get_true_bb());
+      rec.b = target_of(s->get_false_bb());
+      break;
+    }
+    case Switch: {
+      auto s = static_cast<const StmtSwitch*>(stmt);
+      set_operand(0, s->get_cond());
+      rec.a = target_of(s->get_default_bb());
+      rec.b = operands.size();
+      rec.c = s->get_cases().size();
+      for (auto& it: s->get_cases())
+        operands.push_back(ImageOperand { add_constant(it.first), target_of(it.second) });
+      break;
+    }
+    case Malloc: set_operand(0, static_cast<const StmtMalloc*>(stmt)->get_val()); break;
+    case Free: set_operand(0, static_cast<const StmtFree*>(stmt)->get_ptr()); break;
+    case Load: {
+      auto s = static_cast<const StmtLoad*>(stmt);
+      rec.kind = s->get_is_async();
+      rec.size = s->get_size();
+      set_operand(0, s->get_ptr());
+      rec.ops[1] = add_constant(s->get_ofs());
+      break;
+    }
+    case Store: {
+      auto s = static_cast<const StmtStore*>(stmt);
+      rec.size = s->get_size();
+      set_operand(0, s->get_val());
+      set_operand(1, s->get_ptr());
+      rec.ops[2] = add_constant(s->get_ofs());
+      break;
+    }
+    case Bop: {
+      auto s = static_cast<const StmtBop*>(stmt);
+      rec.kind = s->get_bop_kind();
+      rec.size = s->get_size();
+      set_operand(0, s->get_val1());
+      set_operand(1, s->get_val2());
+      break;
+    }
+    case Sum: {
+      auto s = static_cast<const StmtSum*>(stmt);
+      rec.size = s->get_size();
+      set_operands(s->get_values());
+      break;
+    }
+    case Uop: {
+      auto s = static_cast<const StmtUop*>(stmt);
+      rec.kind = s->get_uop_kind();
+      rec.size = s->get_size();
+      set_operand(0, s->get_val());
+      break;
+    }
+    case Select: {
+      auto s = static_cast<const StmtSelect*>(stmt);
+      set_operand(0, s->get_cond());
+      set_operand(1, s->get_val_true());
+      set_operand(2, s->get_val_false());
+      break;
+    }
+    case Call: {
+      auto s = static_cast<const StmtCall*>(stmt);
+      rec.a = s->get_callee() == nullptr ? IMAGE_NONE : function_index.at(s->get_callee());
+      set_operands(s->get_args());
+      rec.ops[0] = add_string(s->get_fname());
+      rec.ops[1] = s->get_fname().size();
+      break;
+    }
+    case Assert: {
+      auto s = static_cast<const StmtAssert*>(stmt);
+      set_operand(0, s->get_op1());
+      set_operand(1, s->get_op2());
+      break;
+    }
+    case Read: break;
+    case Write: set_operand(0, static_cast<const StmtWrite*>(stmt)->get_val()); break;
+    default: break;
+  }
+  return rec;
+}
+
+void ImageWriter::add_function(const Function* function) {
+  ImageFunction rec{};
+  rec.name = add_string(function->get_fname());
+  rec.name_len = function->get_fname().size();
+  rec.nargs = function->get_nargs();
+  rec.first_block = blocks.size();
+  rec.first_stmt = stmts.size();
+
+  // number the statements first, as branches go forward too
+  stmt_index.clear();
+  uint32_t n = 0;
+  for (auto& it: function->get_bbs()) {
+    blocks.push_back(ImageBlock { add_string(it.first), (uint32_t)it.first.size(), n, 0 });
+    for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next())
+      stmt_index[stmt] = n++;
+    blocks.back().nstmts = n - blocks.back().first_stmt;
+  }
+  for (auto& it: function->get_bbs()) {
+    for (Stmt* stmt = it.second; stmt != nullptr; stmt = stmt->get_next())
+      stmts.push_back(stmt_of(stmt));
+  }
+
+  rec.nblocks = blocks.size() - rec.first_block;
+  rec.nstmts = n;
+  functions.push_back(rec);
+}
+
+ImageWriter::ImageWriter(const Program& program) {
+  for (auto function: program.get_functions())
+    function_index.emplace(function, function_index.size());
+  for (auto function: program.get_functions())
+    add_function(function);
+}
+
+/** written to a temporary file first, so that a reader never sees half an image */
+bool ImageWriter::write(const string& path, uint64_t source_hash, uint64_t source_size) const {
+  ImageHeader header{};
+  memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+  header.version = IMAGE_VERSION;
+  header.nfunctions = functions.size();
+  header.source_hash = source_hash;
+  header.source_size = source_size;
+  header.nblocks = blocks.size();
+  header.nstmts = stmts.size();
+  header.noperands = operands.size();
+  header.nconstants = constants.size();
+  header.strings_size = strings.size();
+
+  string body;
+  body.append((const char*)functions.data(), functions.size() * sizeof(ImageFunction));
+  body.append((const char*)blocks.data(), blocks.size() * sizeof(ImageBlock));
+  body.append((const char*)stmts.data(), stmts.size() * sizeof(ImageStmt));
+  body.append((const char*)operands.data(), operands.size() * sizeof(ImageOperand));
+  body.append((const char*)constants.data(), constants.size() * sizeof(uint64_t));
+  body.append(strings.data(), strings.size());
+  header.body_hash = hash_bytes(body);
+
+  string tmp_path = path + ".tmp" + to_string(getpid());
+  FILE* out = fopen(tmp_path.c_str(), "wb");
+  if (out == nullptr)
+    return false;
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(body.data(), 1, body.size(), out);
+  bool ok = !ferror(out);
+  ok = fclose(out) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+/** reading an image */
+
+class ImageReader {
+private:
+  const ImageHeader* header = nullptr;
+  const ImageFunction* functions = nullptr;
+  const ImageBlock* blocks = nullptr;
+  const ImageStmt* stmts = nullptr;
+  const ImageOperand* operands = nullptr;
+  const uint64_t* constants = nullptr;
+  const char* strings = nullptr;
+
+  bool check_operand(uint32_t op) const;
+  Value value_of(uint32_t op) const;
+  bool check_string(uint64_t ofs, uint64_t len) const;
+  bool check_target(uint32_t target, const vector<bool>& heads) const;
+  bool check_stmt(const ImageStmt& rec, bool last, const vector<bool>& heads) const;
+  bool check_function(const ImageFunction& rec, uint32_t first_block, uint32_t first_stmt) const;
+  string_view string_at(uint64_t ofs, uint64_t len) const;
+  ArenaArray<Value> values_of(const ImageStmt& rec, Arena& arena) const;
+  Stmt* place_stmt(const ImageStmt& rec, Program& program) const;
+  void resolve_stmt(const ImageStmt& rec, Stmt* stmt, const vector<Stmt*>& placed,
+                    const vector<Function*>& program_functions) const;
+
+public:
+  bool open(const void* image, size_t size, uint64_t source_hash, uint64_t source_size);
+  bool check() const;
+  Program* build(const string& filename) const;
+};
+
+static bool is_opcode(uint8_t opcode) {
+  return opcode < LEN_OPCODE;
+}
+
+/** how many of the ops of a statement are values */
+static uint32_t value_operands(uint8_t opcode) {
+  switch (opcode) {
+    case Load: case Bop: case Assert: return 2;
+    case Store: case Select: return 3;
+    case BrUncond: case Sum: case Call: case Read: return 0;
+    default: return 1;
+  }
+}
+
+static bool is_terminator(uint8_t opcode) {
+  return opcode == Ret || opcode == BrUncond || opcode == BrCond || opcode == Switch;
+}
+
+
+bool ImageReader::open(const void* image, size_t size, uint64_t source_hash, uint64_t source_size) {
+  if (size < sizeof(ImageHeader))
+    return false;
+  header = (const ImageHeader*)image;
+  if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 || header->version != IMAGE_VERSION ||
+      header->source_hash != source_hash || header->source_size != source_size || header->reserved != 0)
+    return false;
+
+  uint64_t expected = sizeof(ImageHeader) + (uint64_t)header->nfunctions * sizeof(ImageFunction) +
+                      (uint64_t)header->nblocks * sizeof(ImageBlock) + (uint64_t)header->nstmts * sizeof(ImageStmt) +
+                      (uint64_t)header->noperands * sizeof(ImageOperand) +
+                      (uint64_t)header->nconstants * sizeof(uint64_t) + header->strings_size;
+  if (expected != size)
+    return false;
+  if (hash_bytes(string_view((const char*)image + sizeof(ImageHeader), size - sizeof(ImageHeader))) != header->body_hash)
+    return false;
+
+  const char* p = (const char*)image + sizeof(ImageHeader);
+  functions = (const ImageFunction*)p;
+  p += header->nfunctions * sizeof(ImageFunction);
+  blocks = (const ImageBlock*)p;
+  p += header->nblocks * sizeof(ImageBlock);
+  stmts = (const ImageStmt*)p;
+  p += header->nstmts * sizeof(ImageStmt);
+  operands = (const ImageOperand*)p;
+  p += header->noperands * sizeof(ImageOperand);
+  constants = (const uint64_t*)p;
+  p += header->nconstants * sizeof(uint64_t);
+  strings = p;
+  return true;
+}
+
+bool ImageReader::check_operand(uint32_t op) const {
+  return (op & IMAGE_CONSTANT) != 0 ? (op & ~IMAGE_CONSTANT) < header->nconstants : op < RegNone;
+}
+
+Value ImageReader::value_of(uint32_t op) const {
+  return (op & IMAGE_CONSTANT) != 0 ? Value(constants[op & ~IMAGE_CONSTANT]) : Value((Reg)op);
+}
+
+bool ImageReader::check_string(uint64_t ofs, uint64_t len) const {
+  return ofs <= header->strings_size && len <= header->strings_size - ofs;
+}
+
+string_view ImageReader::string_at(uint64_t ofs, uint64_t len) const {
+  return string_view(strings + ofs, len);
+}
+
+bool ImageReader::check_target(uint32_t target, const vector<bool>& heads) const {
+  return target == IMAGE_NONE || (target < heads.size() && heads[target]);
+}
+
+/** the same checks the parser makes, so that a damaged image cannot build a program the interpreter trips over */
+bool ImageReader::check_stmt(const ImageStmt& rec, bool last, const vector<bool>& heads) const {
+  if (!is_opcode(rec.opcode) || is_terminator(rec.opcode) != last)
+    return false;
+  for (uint32_t i = 0; i < value_operands(rec.opcode); i++) {
+    if (!check_operand(rec.ops[i]))
+      return false;
+  }
+  bool has_lhs = rec.opcode == Malloc || rec.opcode == Load || rec.opcode == Bop || rec.opcode == Sum ||
+                 rec.opcode == Uop || rec.opcode == Select;
+  bool may_have_lhs = has_lhs || rec.opcode == Call || rec.opcode == Read || rec.opcode == Write;
+  if (rec.lhs != RegNone && (!may_have_lhs || rec.lhs >= NGPREGS))
+    return false;
+  if (rec.lhs == RegNone && has_lhs)
+    return false;
+
+  auto check_operands = [&]() {
+    if ((uint64_t)rec.b + rec.c > header->noperands)
+      return false;
+    for (uint32_t i = rec.b; i < rec.b + rec.c; i++) {
+      if (!check_operand(operands[i].op))
+        return false;
+    }
+    return true;
+  };
+  auto is_constant = [&](uint32_t op) { return (op & IMAGE_CONSTANT) != 0; };
+
+  switch (rec.opcode) {
+    case BrUncond: return check_target(rec.a, heads);
+    case BrCond: return check_target(rec.a, heads) && check_target(rec.b, heads);
+    case Switch: {
+      if (!check_target(rec.a, heads) || !check_operands())
+        return false;
+      for (uint32_t i = rec.b; i < rec.b + rec.c; i++) {
+        if (!is_constant(operands[i].op) || !check_target(operands[i].target, heads) ||
+            (i > rec.b && value_of(operands[i - 1].op).get_literal() >= value_of(operands[i].op).get_literal()))
+          return false;
+      }
+      return true;
+    }
+    case Load: return rec.kind <= 1 && rec.size <= MSize8 && is_constant(rec.ops[1]);
+    case Store: return rec.size <= MSize8 && is_constant(rec.ops[2]);
+    case Bop: return rec.kind <= Sle && rec.size <= Size64;
+    case Sum: return rec.size <= Size64 && rec.c == StmtSum::num_operands && check_operands();
+    case Uop: return rec.kind <= Decr && rec.size <= Size64;
+    case Call:
+      return (rec.a == IMAGE_NONE || rec.a < header->nfunctions) && check_operands() &&
+             check_string(rec.ops[0], rec.ops[1]);
+    default: return true;
+  }
+}
+
+/** functions and their blocks lie one after the other, no two blocks of a function with the same name */
+bool ImageReader::check_function(const ImageFunction& rec, uint32_t first_block, uint32_t first_stmt) const {
+  if (rec.first_block != first_block || rec.first_stmt != first_stmt || rec.nblocks == 0 ||
+      (uint64_t)rec.first_block + rec.nblocks > header->nblocks ||
+      (uint64_t)rec.first_stmt + rec.nstmts > header->nstmts ||
+      !check_string(rec.name, rec.name_len))
+    return false;
+
+  vector<bool> heads(rec.nstmts, false);
+  unordered_set<string_view> names;
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < rec.nblocks; i++) {
+    const ImageBlock& block = blocks[rec.first_block + i];
+    if (block.first_stmt != n || block.nstmts == 0 || block.nstmts > rec.nstmts - n ||
+        !check_string(block.name, block.name_len))
+      return false;
+    if (!names.insert(string_at(block.name, block.name_len)).second)
+      return false;
+    heads[n] = true;
+    n += block.nstmts;
+  }
+  if (n != rec.nstmts)
+    return false;
+
+  for (uint32_t i = 0; i < rec.nblocks; i++) {
+    const ImageBlock& block = blocks[rec.first_block + i];
+    for (uint32_t j = 0; j < block.nstmts; j++) {
+      if (!check_stmt(stmts[rec.first_stmt + block.first_stmt + j], j + 1 == block.nstmts, heads))
+        return false;
+    }
+  }
+  return true;
+}
+
+/** everything is checked before anything is built, so building cannot fail halfway */
+bool ImageReader::check() const {
+  uint32_t first_block = 0;
+  uint32_t first_stmt = 0;
+  bool has_main = false;
+  unordered_set<string_view> names;
+  for (uint32_t i = 0; i < header->nfunctions; i++) {
+    const ImageFunction& rec = functions[i];
+    if (!check_function(rec, first_block, first_stmt))
+      return false;
+    string_view name = string_at(rec.name, rec.name_len);
+    if (name == "read" || name == "write" || !names.insert(name).second)
+      return false;
+    if (name == "main")
+      has_main = rec.nargs == 0;
+    first_block += rec.nblocks;
+    first_stmt += rec.nstmts;
+  }
+  return has_main && first_block == header->nblocks && first_stmt == header->nstmts;
+}
+
+ArenaArray<Value> ImageReader::values_of(const ImageStmt& rec, Arena& arena) const {
+  Value* values = arena.make_array<Value>(rec.c);
+  for (uint32_t i = 0; i < rec.c; i++)
+    new (values + i) Value(value_of(operands[rec.b + i].op));
+  return ArenaArray<Value>(values, rec.c);
+}
+
+/** targets are left for resolve_stmt, as branches go forward too */
+Stmt* ImageReader::place_stmt(const ImageStmt& rec, Program& program) const {
+  Arena& arena = program.get_arena();
+  Reg lhs = (Reg)rec.lhs;
+  uint32_t nvalues = value_operands(rec.opcode);
+  Value op0 = nvalues > 0 ? value_of(rec.ops[0]) : Value((uint64_t)0);
+  Value op1 = nvalues > 1 ? value_of(rec.ops[1]) : Value((uint64_t)0);
+  Value op2 = nvalues > 2 ? value_of(rec.ops[2]) : Value((uint64_t)0);
+
+  switch (rec.opcode) {
+    case Ret: return arena.make<StmtRet>(rec.line, op0);
+    case BrUncond: return arena.make<StmtBrUncond>(rec.line, string_view());
+    case BrCond: return arena.make<StmtBrCond>(rec.line, op0, string_view(), string_view());
+    case Switch: {
+      auto cases = arena.make_array<pair<uint64_t, Stmt*>>(rec.c);
+      for (uint32_t i = 0; i < rec.c; i++)
+        new (cases + i) pair<uint64_t, Stmt*>(value_of(operands[rec.b + i].op).get_literal(), nullptr);
+      return arena.make<StmtSwitch>(rec.line, op0, ArenaArray<pair<uint64_t, Stmt*>>(cases, rec.c), nullptr,
+                                    string_view());
+    }
+    case Malloc: return arena.make<StmtMalloc>(rec.line, lhs, op0);
+    case Free: return arena.make<StmtFree>(rec.line, op0);
+    case Load: return arena.make<StmtLoad>(rec.line, lhs, rec.kind != 0, (MSize)rec.size, op0, op1.get_literal());
+    case Store: return arena.make<StmtStore>(rec.line, (MSize)rec.size, op0, op1, op2.get_literal());
+    case Bop: return arena.make<StmtBop>(rec.line, lhs, (BopKind)rec.kind, op0, op1, (Size)rec.size);
+    case Sum: return arena.make<StmtSum>(rec.line, lhs, values_of(rec, arena), (Size)rec.size);
+    case Uop: return arena.make<StmtUop>(rec.line, lhs, (UopKind)rec.kind, op0, (Size)rec.size);
+    case Select: return arena.make<StmtSelect>(rec.line, lhs, op0, op1, op2);
+    case Call: {
+      string_view fname = program.get_symbols().intern(string_at(rec.ops[0], rec.ops[1]));
+      return arena.make<StmtCall>(rec.line, lhs, fname, values_of(rec, arena));
+    }
+    case Assert: return arena.make<StmtAssert>(rec.line, op0, op1);
+    case Read: return arena.make<StmtRead>(rec.line, lhs);
+    default: return arena.make<StmtWrite>(rec.line, lhs, op0);
+  }
+}
+
+void ImageReader::resolve_stmt(const ImageStmt& rec, Stmt* stmt, const vector<Stmt*>& placed,
+                               const vector<Function*>& program_functions) const {
+  auto target = [&](uint32_t index) { return index == IMAGE_NONE ? nullptr : placed[index]; };
+  switch (rec.opcode) {
+    case BrUncond: static_cast<StmtBrUncond*>(stmt)->resolve(target(rec.a)); break;
+    case BrCond: static_cast<StmtBrCond*>(stmt)->resolve(target(rec.a), target(rec.b)); break;
+    case Switch: {
+      auto s = static_cast<StmtSwitch*>(stmt);
+      for (uint32_t i = 0; i < rec.c; i++)
+        s->get_cases()[i].second = target(operands[rec.b + i].target);
+      s->resolve(target(rec.a));
+      break;
+    }
+    case Call:
+      static_cast<StmtCall*>(stmt)->resolve(rec.a == IMAGE_NONE ? nullptr : program_functions[rec.a]);
+      break;
+    default: break;
+  }
+}
+
+/** the program lives in its own arena, like a parsed one */
+Program* ImageReader::build(const string& filename) const {
+  auto program = new Program(filename);
+  SymbolTable& symbols = program->get_symbols();
+
+  vector<Function*> program_functions;
+  program_functions.reserve(header->nfunctions);
+  for (uint32_t i = 0; i < header->nfunctions; i++)
+    program_functions.push_back(program->add_function(string_at(functions[i].name, functions[i].name_len),
+                                                      functions[i].nargs));
+
+  vector<Stmt*> placed;
+  for (uint32_t i = 0; i < header->nfunctions; i++) {
+    const ImageFunction& rec = functions[i];
+    Function* function = program_functions[i];
+    const ImageStmt* function_stmts = stmts + rec.first_stmt;
+
+    placed.clear();
+    for (uint32_t j = 0; j < rec.nstmts; j++)
+      placed.push_back(place_stmt(function_stmts[j], *program));
+
+    for (uint32_t j = 0; j < rec.nblocks; j++) {
+      const ImageBlock& block = blocks[rec.first_block + j];
+      for (uint32_t k = block.first_stmt; k + 1 < block.first_stmt + block.nstmts; k++)
+        placed[k]->set_next(placed[k + 1]);
+      function->set_bb(symbols.intern(string_at(block.name, block.name_len)), placed[block.first_stmt]);
+    }
+
+    for (uint32_t j = 0; j < rec.nstmts; j++)
+      resolve_stmt(function_stmts[j], placed[j], placed, program_functions);
+  }
+
+  program->link(false);
+  return program;
+}
+
+
+/** the program in the image at path, or null if there is no usable one */
+static Program* read_image(const string& filename, const string& path, uint64_t source_hash, uint64_t source_size) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(ImageHeader)) {
+    close(fd);
+    return nullptr;
+  }
+  void* image = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED)
+    return nullptr;
+
+  Program* program = nullptr;
+  ImageReader reader;
+  if (reader.open(image, st.st_size, source_hash, source_size) && reader.check())
+    program = reader.build(filename);
+  munmap(image, st.st_size);
+  return program;
+}
+
+Status load_program(const string& filename, const string& cache_dir, Program*& program) {
+  program = nullptr;
+  SourceFile input;
+  if (!input.open(filename))
+    return Status(ErrorFile, filename, 0, "");
+  string_view src = input.get_contents();
+  uint64_t source_hash = hash_bytes(src);
+  string path = image_path(filename, cache_dir, source_hash);
+
+  program = read_image(filename, path, source_hash, src.size());
+  if (program != nullptr)
+    return Status();
+
+  Status status = parse_source(filename, src, program);
+  if (status.ok()) {
+    // the cache is only an aid: a directory that cannot be written just leaves it empty
+    if (!cache_dir.empty())
+      mkdir(cache_dir.c_str(), 0755);
+    ImageWriter(*program).write(path, source_hash, src.size());
+  }
+  return status;
+}
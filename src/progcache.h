@@ -0,0 +1,25 @@
+#ifndef SWPP_ASM_INTERPRETER_PROGCACHE_H
+#define SWPP_ASM_INTERPRETER_PROGCACHE_H
+
+#include <string>
+
+#include "program.h"
+#include "error.h"
+
+using namespace std;
+
+/** the file name ending of a program image */
+#define PROGRAM_IMAGE_SUFFIX ".swppc"
+
+
+/**
+ * parses filename like parse(), going through a binary image of the parsed
+ * program: functions, blocks, statements with their targets resolved, and
+ * the line of every statement. with an empty cache_dir the image is kept
+ * next to the source as <filename>.swppc, otherwise in cache_dir under the
+ * hash of the source. an image made from another source, or one that is
+ * damaged or not well formed, is ignored and written anew from the text.
+ */
+Status load_program(const string& filename, const string& cache_dir, Program*& program);
+
+#endif //SWPP_ASM_INTERPRETER_PROGCACHE_H
@@ -1,19 +1,81 @@
 #include "program.h"
+#include "bytecode.h"
 
 
-Program::Program(): function_map() {}
+Program::Program(string _filename): filename(move(_filename)), arena(), symbols(arena), functions(), function_map(), bytecode(),
+bytecode_once() {}
 
-Function * Program::get_function(const string &fname) {
+Program::~Program() = default;
+
+const string& Program::get_filename() const { return filename; }
+
+Arena& Program::get_arena() { return arena; }
+
+SymbolTable& Program::get_symbols() { return symbols; }
+
+/** bytes of memory the functions and statements take */
+size_t Program::get_size() const { return arena.get_size(); }
+
+/** in the order they are defined */
+const vector<Function*>& Program::get_functions() const { return functions; }
+
+Function * Program::get_function(string_view fname) const {
   auto it = function_map.find(fname);
   if (it == function_map.end())
     return nullptr;
   return it->second;
 }
 
-bool Program::set_function(const string &fname, Function * function) {
-  auto it = function_map.find(fname);
-  if (it != function_map.end())
-    return false;
-  function_map.insert(pair<string, Function*>(fname, function));
+/** a new function, or null if the name is taken */
+Function* Program::add_function(string_view fname, int nargs) {
+  if (function_map.count(fname) != 0)
+    return nullptr;
+  auto function = arena.make<Function>(symbols.intern(fname), nargs);
+  function_map.emplace(function->get_fname(), function);
+  functions.push_back(function);
+  return function;
+}
+
+/**
+ * moves the functions of other, a program parsed from another part of the
+ * same source, here along with its arena; false if a name is taken
+ */
+bool Program::take_functions(Program& other) {
+  arena.absorb(other.arena);
+  vector<Function*> moved;
+  moved.swap(other.functions);
+  other.function_map.clear();
+  for (Function* function: moved) {
+    if (!function_map.emplace(function->get_fname(), function).second)
+      return false;
+    functions.push_back(function);
+  }
   return true;
 }
+
+void Program::link(bool resolve_stmts) {
+  for (Function* function: functions)
+    function->link(*this, resolve_stmts);
+
+  // propagate clobbers up the call graph until they settle
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Function* function: functions)
+      changed |= function->add_callee_clobbers();
+  }
+}
+
+/**
+ * the program lowered to bytecode for the profiled engine or the other;
+ * the first caller lowers it and has thread install its handlers, while
+ * callers from other threads wait for it
+ */
+BytecodeProgram* Program::get_bytecode(bool profiled, const function<void(BytecodeProgram&)>& thread) const {
+  call_once(bytecode_once[profiled], [&]() {
+    auto lowered = make_unique<BytecodeProgram>(*this);
+    thread(*lowered);
+    bytecode[profiled] = move(lowered);
+  });
+  return bytecode[profiled].get();
+}
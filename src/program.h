@@ -1,22 +1,56 @@
 #ifndef SWPP_ASM_INTERPRETER_PROGRAM_H
 #define SWPP_ASM_INTERPRETER_PROGRAM_H
 
-#include <map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "function.h"
+#include "arena.h"
 
 using namespace std;
 
+class BytecodeProgram;
 
+/**
+ * a parsed and linked program. it is not changed by running it, so any
+ * number of States may run one program at the same time. its functions
+ * and statements live in its arena, and go all at once with it. the
+ * bytecode it lowers to is built on the first run that asks for it and
+ * kept for the later ones, once for the profiled engine and once for the
+ * other, as each threads its own handlers into it.
+ */
 class Program {
 private:
-  map<string, Function*> function_map;
+  const string filename;
+  Arena arena;
+  SymbolTable symbols;
+  vector<Function*> functions;
+  unordered_map<string_view, Function*> function_map;
+  mutable unique_ptr<BytecodeProgram> bytecode[2];
+  mutable once_flag bytecode_once[2];
 
 public:
-  Program();
-
-  Function* get_function(const string& fname);
-  bool set_function(const string& fname, Function* function);
+  explicit Program(string _filename);
+  ~Program();
+  Program(const Program&) = delete;
+  Program& operator=(const Program&) = delete;
+
+  const string& get_filename() const;
+  Arena& get_arena();
+  SymbolTable& get_symbols();
+  size_t get_size() const;
+
+  const vector<Function*>& get_functions() const;
+  Function* get_function(string_view fname) const;
+  Function* add_function(string_view fname, int nargs);
+  bool take_functions(Program& other);
+  void link(bool resolve_stmts = true);
+  BytecodeProgram* get_bytecode(bool profiled, const function<void(BytecodeProgram&)>& thread) const;
 };
 
 #endif //SWPP_ASM_INTERPRETER_PROGRAM_H
@@ -0,0 +1,67 @@
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+
+bool make_address(const string& socket_path, sockaddr_un& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path))
+    return false;
+  memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+  return true;
+}
+
+bool read_exact(int fd, void* buf, size_t len) {
+  char* p = (char*)buf;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool read_string(int fd, string& str) {
+  uint64_t len;
+  if (!read_exact(fd, &len, sizeof(len)) || len > PROTOCOL_MAX_STRING)
+    return false;
+  str.resize(len);
+  return read_exact(fd, &str[0], len);
+}
+
+bool send_all(int fd, const void* buf, size_t len) {
+  const char* p = (const char*)buf;
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool send_frame(int fd, char kind, string_view payload) {
+  char header[FRAME_HEADER_SIZE];
+  uint64_t len = payload.size();
+  header[0] = kind;
+  memcpy(header + 1, &len, sizeof(len));
+  return send_all(fd, header, sizeof(header)) && send_all(fd, payload.data(), payload.size());
+}
+
+void append_string(string& buf, const string& str) {
+  uint64_t len = str.size();
+  buf.append((const char*)&len, sizeof(len));
+  buf.append(str);
+}
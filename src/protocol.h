@@ -0,0 +1,37 @@
+#ifndef SWPP_ASM_INTERPRETER_PROTOCOL_H
+#define SWPP_ASM_INTERPRETER_PROTOCOL_H
+
+#include <cinttypes>
+#include <string>
+#include <string_view>
+
+#include <sys/un.h>
+
+using namespace std;
+
+/**
+ * a job, sent by swpp-client to the server on a Unix domain socket:
+ *   "SWPP", engine (u8), cost tree (u8), max call depth (u64),
+ *   file name (u64 length + bytes), program source (u64 length + bytes)
+ * and then the guest's input, raw, until the client shuts its side down.
+ * the server answers with frames of a kind (u8), a length (u64) and a payload:
+ *   'o': guest output, as it is produced (the error message of a failed run too)
+ *   'l': a log file, as its name, a '\0' and its contents
+ *   'x': the exit code of the run (one byte); the last frame
+ * integers are in host byte order, as both ends are on the same host.
+ */
+#define PROTOCOL_MAGIC "SWPP"
+/** a file name or a program larger than this is not a job */
+#define PROTOCOL_MAX_STRING ((uint64_t)1 << 30)
+#define FRAME_HEADER_SIZE (1 + sizeof(uint64_t))
+
+
+bool make_address(const string& socket_path, sockaddr_un& addr);
+bool read_exact(int fd, void* buf, size_t len);
+bool read_string(int fd, string& str);
+/** writes all of buf to a blocking socket; a peer that went away is not a signal */
+bool send_all(int fd, const void* buf, size_t len);
+bool send_frame(int fd, char kind, string_view payload);
+void append_string(string& buf, const string& str);
+
+#endif //SWPP_ASM_INTERPRETER_PROTOCOL_H
@@ -1,6 +1,8 @@
 #ifndef SWPP_ASM_INTERPRETER_REG_H
 #define SWPP_ASM_INTERPRETER_REG_H
 
+#include <cinttypes>
+
 #define NREGS 49
 #define NGPREGS 32
 #define NARGREGS 16
@@ -15,4 +17,18 @@ enum Reg {
   RegNone = 49
 };
 
+/** a set of registers, one bit per Reg */
+typedef uint64_t RegMask;
+
+inline RegMask reg_mask(Reg reg) {
+  return reg == RegNone ? 0 : (RegMask)1 << reg;
+}
+
+/** arg1 .. arg<nargs>, capped at arg16 */
+inline RegMask arg_reg_mask(int nargs) {
+  if (nargs > NARGREGS)
+    nargs = NARGREGS;
+  return (((RegMask)1 << nargs) - 1) << A1;
+}
+
 #endif //SWPP_ASM_INTERPRETER_REG_H
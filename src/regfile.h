@@ -6,10 +6,18 @@
 #include <utility>
 
 #include "reg.h"
+#include "error.h"
 
 using namespace std;
 
 
+/** a register's value and pending async load, as saved across a call */
+struct SavedReg {
+  uint64_t val;
+  double async;
+};
+
+
 class RegFile {
 private:
   uint64_t regfile[NREGS];
@@ -25,12 +33,79 @@ public:
     return (R1 <= reg && reg <= R32) || (reg == RegSp);
   }
 
+  int get_nargs() const;
   void set_nargs(int _nargs);
   void set_value(Reg reg, uint64_t val);
   pair<uint64_t, double> read_reg(Reg reg);
+  pair<uint64_t, double> peek_reg(Reg reg) const;
   void write_reg(Reg reg, uint64_t val);
   void set_async(Reg reg, double cost);
+  void save(RegMask mask, RegMask resolved, SavedReg* area) const;
+  void restore(RegMask mask, const SavedReg* area);
   string to_string() const;
 };
 
+
+/** register accesses sit on the hot path of every instruction */
+
+inline void RegFile::set_value(Reg reg, uint64_t val) {
+  if (reg == RegNone)
+    return;
+  regfile[reg] = val;
+}
+
+inline double RegFile::resolve_async(Reg reg) {
+  if (!is_writable(reg))
+    return -1.0;
+  double wait_until = async[reg];
+  async[reg] = -1.0;
+  return wait_until;
+}
+
+inline pair<uint64_t, double> RegFile::read_reg(Reg reg) {
+  if (reg == RegNone)
+    invoke_runtime_error("reading an unknown register");
+  if ((int)A1 + nargs <= reg && reg <= A16)
+    invoke_runtime_error("reading out-of-range argument");
+  return make_pair(regfile[reg], this->resolve_async(reg));
+}
+
+/** reads like read_reg, but leaves a pending async load pending */
+inline pair<uint64_t, double> RegFile::peek_reg(Reg reg) const {
+  if (reg == RegNone)
+    invoke_runtime_error("reading an unknown register");
+  if ((int)A1 + nargs <= reg && reg <= A16)
+    invoke_runtime_error("reading out-of-range argument");
+  return make_pair(regfile[reg], is_writable(reg) ? async[reg] : -1.0);
+}
+
+inline void RegFile::write_reg(Reg reg, uint64_t val) {
+  if (reg == RegNone)
+    return;
+  if (A1 <= reg && reg <= A16)
+    invoke_runtime_error("writing to a read-only register");
+  resolve_async(reg);
+  regfile[reg] = val;
+}
+
+/**
+ * copies the registers in mask to area, in register order. the ones in
+ * resolved are saved with their async load resolved, as if they were read.
+ */
+inline void RegFile::save(RegMask mask, RegMask resolved, SavedReg* area) const {
+  for (; mask != 0; mask &= mask - 1, area++) {
+    int reg = __builtin_ctzll(mask);
+    area->val = regfile[reg];
+    area->async = (resolved >> reg) & 1 ? -1.0 : async[reg];
+  }
+}
+
+inline void RegFile::restore(RegMask mask, const SavedReg* area) {
+  for (; mask != 0; mask &= mask - 1, area++) {
+    int reg = __builtin_ctzll(mask);
+    regfile[reg] = area->val;
+    async[reg] = area->async;
+  }
+}
+
 #endif //SWPP_ASM_INTERPRETER_REGFILE_H
@@ -0,0 +1,90 @@
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include "report.h"
+
+
+static void write_status_log(ostream& log, const State& state, uint64_t ret) {
+  double exec_cost = state.get_cost_value();
+  double max_heap_size = state.get_max_alloced_size();
+  log << fixed << setprecision(4);
+  log << "Returned: " << ret << endl;
+  log << "Execution cost: " << exec_cost << endl;
+  log << "Max heap usage (bytes): " << max_heap_size << endl;
+  log << "Total cost: " << exec_cost + max_heap_size * 1024.0 << endl;
+}
+
+/** the cost tree is written as it is walked, as it may have a node per call */
+static void write_cost_log(ostream& cost_log, const State& state, uint64_t ret) {
+  cost_log << fixed << setprecision(4);
+  cost_log << "Total waiting cost: " << state.get_total_wait_cost() << endl;
+  state.get_cost_tree()->write(cost_log);
+}
+
+static void write_inst_log(ostream& inst_log, const State& state, uint64_t ret) {
+  inst_log << state.inst_log_to_string();
+}
+
+static void write_profile_log(ostream& profile_log, const State& state, uint64_t ret) {
+  state.get_profile()->write_report(profile_log);
+}
+
+/** the source is read again, as the program keeps no text */
+static void write_profile_source(ostream& profile_source, const State& state, uint64_t ret) {
+  ifstream source(state.get_profile()->get_program().get_filename());
+  state.get_profile()->write_annotated(profile_source, source);
+}
+
+static void write_profile_edges(ostream& profile_edges, const State& state, uint64_t ret) {
+  state.get_profile()->write_edges(profile_edges);
+}
+
+static void write_profile_values(ostream& profile_values, const State& state, uint64_t ret) {
+  state.get_profile()->write_values(profile_values);
+}
+
+/** the logs of a run, by file name, and the least a run must profile to write them */
+static const struct {
+  const char* name;
+  void (*write)(ostream& out, const State& state, uint64_t ret);
+  ProfileKind profile;
+} logs[] = {
+  { "swpp-interpreter.log", write_status_log, ProfileNone },
+  { "swpp-interpreter-cost.log", write_cost_log, ProfileNone },
+  { "swpp-interpreter-inst.log", write_inst_log, ProfileNone },
+  { PROFILE_LOG, write_profile_log, ProfileCosts },
+  { PROFILE_SOURCE, write_profile_source, ProfileCosts },
+  { PROFILE_EDGES, write_profile_edges, ProfileCosts },
+  { PROFILE_VALUES, write_profile_values, ProfileValues },
+};
+
+/** whether a run profiled enough to write a log */
+static bool has_log(const State& state, ProfileKind kind) {
+  if (kind == ProfileNone)
+    return true;
+  const Profile* profile = state.get_profile();
+  return profile != nullptr && (kind == ProfileCosts || profile->counts_values());
+}
+
+vector<pair<string, string>> make_logs(const State& state, uint64_t ret) {
+  vector<pair<string, string>> contents;
+  for (auto& log: logs) {
+    if (!has_log(state, log.profile))
+      continue;
+    stringstream ss;
+    log.write(ss, state, ret);
+    contents.emplace_back(log.name, ss.str());
+  }
+  return contents;
+}
+
+void write_logs(const State& state, uint64_t ret, const string& dir) {
+  for (auto& log: logs) {
+    if (!has_log(state, log.profile))
+      continue;
+    ofstream out(dir + log.name);
+    log.write(out, state, ret);
+    out.close();
+  }
+}
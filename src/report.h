@@ -0,0 +1,30 @@
+#ifndef SWPP_ASM_INTERPRETER_REPORT_H
+#define SWPP_ASM_INTERPRETER_REPORT_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "state.h"
+
+using namespace std;
+
+/** what a profiled run writes besides the logs: the report, the annotated source and the edge counts */
+#define PROFILE_LOG "swpp-interpreter-profile.log"
+#define PROFILE_SOURCE "swpp-interpreter-profile.s"
+#define PROFILE_EDGES "swpp-interpreter-profile-edges.log"
+/** and, profiling values, their histograms */
+#define PROFILE_VALUES "swpp-interpreter-profile-values.log"
+
+/**
+ * the logs of a finished run, as (file name, contents):
+ * swpp-interpreter.log, swpp-interpreter-cost.log and swpp-interpreter-inst.log,
+ * then PROFILE_LOG, PROFILE_SOURCE and PROFILE_EDGES if the run was profiled,
+ * and PROFILE_VALUES if it profiled values
+ */
+vector<pair<string, string>> make_logs(const State& state, uint64_t ret);
+
+/** writes the logs of a finished run to dir (empty for the current directory) */
+void write_logs(const State& state, uint64_t ret, const string& dir);
+
+#endif //SWPP_ASM_INTERPRETER_REPORT_H
@@ -0,0 +1,199 @@
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "protocol.h"
+#include "parser.h"
+#include "report.h"
+
+
+
+/**
+ * the parsed programs, keyed by a hash of their file name and source. the
+ * name is part of the key as it shows up in error messages. a job holds on
+ * to its program, so dropping one from the cache never pulls it from under
+ * a running job.
+ */
+class ProgramCache {
+private:
+  struct Entry {
+    string filename;
+    string source;
+    shared_ptr<const Program> program;
+    list<uint64_t>::iterator lru_pos;
+  };
+
+  mutex lock;
+  map<uint64_t, Entry> entries;
+  list<uint64_t> lru;
+
+  static uint64_t hash_of(const string& filename, const string& source);
+  bool find(uint64_t hash, const string& filename, const string& source, shared_ptr<const Program>& program);
+
+public:
+  Status get(const string& filename, const string& source, shared_ptr<const Program>& program);
+};
+
+/** 64-bit FNV-1a */
+uint64_t ProgramCache::hash_of(const string& filename, const string& source) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c: filename)
+    hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+  hash = (hash ^ 0) * 1099511628211ull;
+  for (char c: source)
+    hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+  return hash;
+}
+
+bool ProgramCache::find(uint64_t hash, const string& filename, const string& source,
+                        shared_ptr<const Program>& program) {
+  auto it = entries.find(hash);
+  if (it == entries.end() || it->second.filename != filename || it->second.source != source)
+    return false;
+  lru.splice(lru.begin(), lru, it->second.lru_pos);
+  program = it->second.program;
+  return true;
+}
+
+/** a program that does not parse is not cached; its jobs fail fast anyway */
+Status ProgramCache::get(const string& filename, const string& source, shared_ptr<const Program>& program) {
+  uint64_t hash = hash_of(filename, source);
+  {
+    lock_guard<mutex> guard(lock);
+    if (find(hash, filename, source, program))
+      return Status();
+  }
+
+  // parsed outside the lock, so a big program does not hold up the other jobs
+  Program* parsed;
+  Status status = parse_source(filename, source, parsed);
+  if (!status.ok())
+    return status;
+  program = shared_ptr<const Program>(parsed);
+
+  lock_guard<mutex> guard(lock);
+  auto it = entries.find(hash);
+  if (it != entries.end()) {
+    lru.erase(it->second.lru_pos);
+    entries.erase(it);
+  }
+  lru.push_front(hash);
+  entries[hash] = Entry { filename, source, program, lru.begin() };
+  if (entries.size() > SERVER_CACHE_SIZE) {
+    entries.erase(lru.back());
+    lru.pop_back();
+  }
+  return Status();
+}
+
+
+/** the guest output of a job goes back as 'o' frames */
+static ssize_t write_output_frame(void* cookie, const char* buf, size_t size) {
+  int fd = *(int*)cookie;
+  return send_frame(fd, 'o', string_view(buf, size)) ? (ssize_t)size : -1;
+}
+
+static void serve_job(int fd, ProgramCache& cache) {
+  char magic[4];
+  uint8_t engine;
+  uint8_t cost_tree;
+  uint64_t max_call_depth;
+  string filename;
+  string source;
+  if (!read_exact(fd, magic, sizeof(magic)) || memcmp(magic, PROTOCOL_MAGIC, sizeof(magic)) != 0 ||
+      !read_exact(fd, &engine, sizeof(engine)) || !read_exact(fd, &cost_tree, sizeof(cost_tree)) ||
+      !read_exact(fd, &max_call_depth, sizeof(max_call_depth)) ||
+      !read_string(fd, filename) || !read_string(fd, source)) {
+    close(fd);
+    return;
+  }
+
+  shared_ptr<const Program> program;
+  Status status = cache.get(filename, source, program);
+  if (!status.ok()) {
+    send_frame(fd, 'o', status.to_string() + "\n");
+    send_frame(fd, 'x', string(1, (char)EXIT_FAILURE));
+    close(fd);
+    return;
+  }
+
+  // the rest of the stream is the guest's input, so the run reads the socket itself
+  cookie_io_functions_t functions = { nullptr, write_output_frame, nullptr, nullptr };
+  FILE* out = fopencookie(&fd, "w", functions);
+  State state(fd, out);
+  state.set_program(program.get());
+  state.set_engine(engine == EngineBytecode ? EngineBytecode : EngineTree);
+  state.set_cost_tree(cost_tree == CostTreeCalls ? CostTreeCalls : CostTreeContexts);
+  state.set_max_call_depth(max_call_depth);
+  uint64_t ret;
+  status = state.exec_program(ret);
+  if (!status.ok())
+    fprintf(out, "%s\n", status.to_string().c_str());
+  fclose(out);
+
+  if (status.ok()) {
+    for (auto& it: make_logs(state, ret))
+      send_frame(fd, 'l', it.first + '\0' + it.second);
+  }
+  send_frame(fd, 'x', string(1, (char)(status.ok() ? 0 : EXIT_FAILURE)));
+  close(fd);
+}
+
+/**
+ * only a socket nobody listens on is left by a server that is gone and may
+ * be removed; any other file at the path is kept, and the server refuses it
+ */
+static bool remove_stale_socket(const string& socket_path, const sockaddr_un& addr) {
+  struct stat st;
+  if (lstat(socket_path.c_str(), &st) < 0)
+    return errno == ENOENT;
+  if (!S_ISSOCK(st.st_mode)) {
+    cout << "Error: " << socket_path << " exists and is not a socket" << endl;
+    return false;
+  }
+  int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  bool live = probe >= 0 && connect(probe, (const sockaddr*)&addr, sizeof(addr)) == 0;
+  if (probe >= 0)
+    close(probe);
+  if (live) {
+    cout << "Error: a server is already listening on " << socket_path << endl;
+    return false;
+  }
+  return unlink(socket_path.c_str()) == 0 || errno == ENOENT;
+}
+
+int run_server(const string& socket_path) {
+  sockaddr_un addr;
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || !make_address(socket_path, addr)) {
+    cout << "Error: cannot listen on " << socket_path << endl;
+    return 1;
+  }
+
+  if (!remove_stale_socket(socket_path, addr)) {
+    cout << "Error: cannot listen on " << socket_path << endl;
+    return 1;
+  }
+  if (bind(sock, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(sock, SOMAXCONN) < 0) {
+    cout << "Error: cannot listen on " << socket_path << endl;
+    return 1;
+  }
+
+  ProgramCache cache;
+  while (true) {
+    int fd = accept(sock, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    thread(serve_job, fd, ref(cache)).detach();
+  }
+}
@@ -0,0 +1,18 @@
+#ifndef SWPP_ASM_INTERPRETER_SERVER_H
+#define SWPP_ASM_INTERPRETER_SERVER_H
+
+#include <string>
+
+using namespace std;
+
+/** parsed programs the server keeps, least recently used dropped first */
+#define SERVER_CACHE_SIZE 64
+
+
+/**
+ * serves jobs (see protocol.h) on socket_path until killed. every job runs
+ * on its own thread; programs are parsed once and cached by their contents.
+ */
+int run_server(const string& socket_path);
+
+#endif //SWPP_ASM_INTERPRETER_SERVER_H
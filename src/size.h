@@ -1,24 +1,39 @@
-#ifndef SWPP_ASM_INTERPRETER_SIZE_H
-#define SWPP_ASM_INTERPRETER_SIZE_H
-
-
-enum MSize {
-  MSize1 = 0,
-  MSize2,
-  MSize4,
-  MSize8
-};
-
-enum Size{
-  Size1 = 0,
-  Size8,
-  Size16,
-  Size32,
-  Size64
-};
-
-int msize_of(MSize msize);
-
-int bw_of(Size size);
-
-#endif //SWPP_ASM_INTERPRETER_SIZE_H
+#ifndef SWPP_ASM_INTERPRETER_SIZE_H
+#define SWPP_ASM_INTERPRETER_SIZE_H
+
+
+enum MSize {
+  MSize1 = 0,
+  MSize2,
+  MSize4,
+  MSize8
+};
+
+enum Size{
+  Size1 = 0,
+  Size8,
+  Size16,
+  Size32,
+  Size64
+};
+
+int msize_of(MSize msize);
+
+/** inline so that a width known at compile time folds away (see alu.h) */
+inline int bw_of(Size size) {
+  switch (size) {
+    case Size1:
+      return 1;
+    case Size8:
+      return 8;
+    case Size16:
+      return 16;
+    case Size32:
+      return 32;
+    case Size64:
+      return 64;
+  }
+  __builtin_unreachable();
+}
+
+#endif //SWPP_ASM_INTERPRETER_SIZE_H
@@ -1,31 +1,17 @@
 #include <sstream>
 #include <iomanip>
 
-#include "state.h"
-#include "error.h"
-
-
-CostStack::CostStack(const string &_fname): fname(_fname), cost(0), callees() {}
+#include <unistd.h>
 
-double CostStack::get_cost() const { return cost; }
-
-void CostStack::add_cost(double _cost) { cost += _cost; }
-
-void CostStack::set_callee(CostStack *callee) {
-  callees.push_back(callee);
-}
+#include "state.h"
 
-string CostStack::to_string(const string& indent) const {
-  stringstream ss;
-  ss << fixed << setprecision(4);
-  ss << indent << fname << ": " << cost << endl;
-  for (auto it: callees)
-    ss << it->to_string(indent + "| ");
-  return ss.str();
-}
 
+State::State(): State(STDIN_FILENO, stdout) {}
 
-State::State(): regfile(), memory(), main_cost(nullptr), total_wait_cost(0), program(nullptr) {
+State::State(int _in_fd, FILE* _out): regfile(), memory(), io(_in_fd, _out), machine(&NormalMachine), line(0),
+cost_tree_kind(CostTreeContexts), cost_tree(nullptr), profile_kind(ProfileNone), profile(nullptr), total_wait_cost(0), program(nullptr),
+engine(EngineTree), bytecode(nullptr), max_call_depth(DEFAULT_MAX_CALL_DEPTH), frames(), bytecode_frames(),
+save_area(), save_top(0) {
   for(int i=0;i<LEN_MACHINE;i++){
     for(int j=0;j<LEN_OPCODE;j++){
       cost_per_inst[i][j] = 0.0;
@@ -39,101 +25,193 @@ State::State(): regfile(), memory(), main_cost(nullptr), total_wait_cost(0), pro
   }
 }
 
-void State::set_program(Program* _program) {
+State::~State() {
+  delete cost_tree;
+  delete profile;
+}
+
+void State::set_program(const Program* _program) {
   if (program == nullptr)
     program = _program;
 }
 
-double State::get_cost_value() const { return main_cost->get_cost(); }
+void State::set_engine(EngineKind _engine) { engine = _engine; }
+
+void State::set_max_call_depth(size_t _max_call_depth) { max_call_depth = _max_call_depth; }
+
+void State::set_cost_tree(CostTreeKind _cost_tree_kind) { cost_tree_kind = _cost_tree_kind; }
+
+void State::set_profile(ProfileKind _profile_kind) { profile_kind = _profile_kind; }
+
+double State::get_cost_value() const { return cost_tree->get_root()->cost; }
+
+const CostTree* State::get_cost_tree() const { return cost_tree; }
 
-CostStack * State::get_cost() const { return main_cost; }
+/** null unless the run was profiled */
+const Profile* State::get_profile() const { return profile; }
 
 uint64_t State::get_max_alloced_size() const {
   return memory.get_max_alloced_size();
 }
 
 void State::update_cost_log(Opcode opcode, double inst_cost, double wait_cost) {
-  cost_per_inst[CurrentMachine->machine_kind][opcode] += inst_cost;
-  inst_count[CurrentMachine->machine_kind][opcode]++;
+  cost_per_inst[machine->machine_kind][opcode] += inst_cost;
+  inst_count[machine->machine_kind][opcode]++;
   total_wait_cost += wait_cost;
 }
 
-uint64_t State::exec_function(CostStack* parent, Function* function) {
-  auto cost = new CostStack(function->get_fname());
-  if (parent == nullptr)
-    main_cost = cost;
-  else
-    parent->set_callee(cost);
+/** logs what the block ended by stmt does on every run; see Function::count_block_costs */
+void State::log_block(const StmtTerminator* stmt) {
+  if (profile != nullptr)
+    profile->add_block(stmt->get_line());
+
+  const BlockCost* block_costs = stmt->get_block_costs();
+  int n = stmt->get_nblock_costs();
+  double* cost_log = cost_per_inst[machine->machine_kind];
+  int* count_log = inst_count[machine->machine_kind];
+  for (int i = 0; i < n; i++) {
+    cost_log[block_costs[i].opcode] += block_costs[i].cost;
+    count_log[block_costs[i].opcode] += block_costs[i].count;
+  }
+}
+
+/** saves the caller's registers in mask across a call; see RegFile::save */
+void State::push_saved_regs(RegMask mask, RegMask resolved) {
+  size_t n = __builtin_popcountll(mask);
+  if (save_top + n > save_area.size())
+    save_area.resize(max(save_area.size() * 2, save_top + n));
+  regfile.save(mask, resolved, save_area.data() + save_top);
+  save_top += n;
+}
+
+void State::pop_saved_regs(RegMask mask) {
+  save_top -= __builtin_popcountll(mask);
+  regfile.restore(mask, save_area.data() + save_top);
+}
+
+/**
+ * runs main to completion. a guest call pushes the caller as a Frame and
+ * continues in the callee, and a ret pops it again, so the host stack does
+ * not grow with the guest call depth.
+ *
+ * the cost of the running call is kept in cost_acc, and goes to its
+ * CostNode on ret. the counts and the costs that are the same on every
+ * run are logged per block by its terminator, so a statement only logs
+ * what depends on the run: its wait, and the cost of a load or a store.
+ */
+uint64_t State::exec_function(const Function* function) {
+  CostNode* cost = cost_tree->get_root();
+  double cost_acc = 0;
+  double wait_acc = 0;
 
   Stmt* curr = function->get_first_bb();
   if (curr == nullptr)
     invoke_runtime_error("missing first basic block");
 
   while (true) {
-    error_line_num = curr->get_line();
+    line = curr->get_line();
+    Opcode opcode = curr->get_opcode();
 
-    switch (curr->get_opcode()) {
+    switch (opcode) {
       case Ret: {
-        auto stmt = dynamic_cast<StmtRet*>(curr);
-        auto ret = stmt->get_val(cost->get_cost(), regfile);
-        cost->add_cost(CurrentMachine->machine_cost->RET + ret.second);
-        update_cost_log(Ret, CurrentMachine->machine_cost->RET, ret.second);
-        if (parent != nullptr)
-          parent->add_cost(cost->get_cost());
-        switch_to_normal();
-        return ret.first;
+        auto stmt = static_cast<StmtRet*>(curr);
+        auto ret = stmt->get_val(cost_acc, regfile);
+        cost_acc += machine->machine_cost->RET + ret.second;
+        wait_acc += ret.second;
+        log_block(stmt);
+        if (profile != nullptr) {
+          profile->add_wait(line, ret.second);
+          profile->resolve_async(regfile, line, cost_acc - machine->machine_cost->RET - ret.second, ret.second);
+        }
+        cost->cost += cost_acc;
+        machine = &NormalMachine;
+        if (frames.empty()) {
+          total_wait_cost += wait_acc;
+          return ret.first;
+        }
+
+        Frame& frame = frames.back();
+        cost_acc += frame.cost_acc;
+        cost = frame.cost;
+        pop_saved_regs(frame.saved);
+        regfile.set_nargs(frame.nargs);
+        regfile.write_reg(frame.call->get_lhs(), ret.first);
+        if (profile != nullptr) {
+          profile->leave_call(frame.saved);
+          profile->resolve_async(regfile, frame.call->get_line(), cost_acc, 0);
+        }
+        curr = frame.call->get_next();
+        frames.pop_back();
+        break;
       }
       case BrUncond: {
-        auto stmt = dynamic_cast<StmtBrUncond*>(curr);
-        string bb = stmt->get_bb();
-        curr = function->get_bb(bb);
+        auto stmt = static_cast<StmtBrUncond*>(curr);
+        curr = stmt->get_bb();
         if (curr == nullptr) {
           invoke_runtime_error("branching to an undefined basic block");
           return 0;
         }
-        cost->add_cost(CurrentMachine->machine_cost->BRUNCOND);
-        update_cost_log(BrUncond, CurrentMachine->machine_cost->BRUNCOND, 0);
+        cost_acc += machine->machine_cost->BRUNCOND;
+        log_block(stmt);
         break;
       }
       case BrCond: {
-        auto stmt = dynamic_cast<StmtBrCond*>(curr);
-        auto bb = stmt->get_bb(cost->get_cost(), regfile);
-        curr = function->get_bb(bb.first);
+        auto stmt = static_cast<StmtBrCond*>(curr);
+        bool eval;
+        auto bb = stmt->get_bb(cost_acc, regfile, eval);
+        curr = bb.first;
         if (curr == nullptr) {
           invoke_runtime_error("branching to an undefined basic block");
           return 0;
         }
-        double inst_cost = stmt->get_eval() ? CurrentMachine->machine_cost->BRCOND_TRUE : CurrentMachine->machine_cost->BRCOND_FALSE;
-        cost->add_cost(inst_cost + bb.second);
-        update_cost_log(BrCond, inst_cost, bb.second);
+        double inst_cost = eval ? machine->machine_cost->BRCOND_TRUE : machine->machine_cost->BRCOND_FALSE;
+        cost_acc += inst_cost + bb.second;
+        wait_acc += bb.second;
+        cost_per_inst[machine->machine_kind][BrCond] += inst_cost;
+        log_block(stmt);
+        if (profile != nullptr) {
+          profile->add_cost(line, inst_cost);
+          profile->add_wait(line, bb.second);
+          profile->resolve_async(regfile, line, cost_acc - inst_cost - bb.second, bb.second);
+          if (eval)
+            profile->add_taken(line);
+        }
         break;
       }
       case Switch: {
-        auto stmt = dynamic_cast<StmtSwitch*>(curr);
-        auto bb = stmt->get_bb(cost->get_cost(), regfile);
-        curr = function->get_bb(bb.first);
+        auto stmt = static_cast<StmtSwitch*>(curr);
+        auto bb = stmt->get_bb(cost_acc, regfile);
+        curr = bb.first;
         if (curr == nullptr) {
           invoke_runtime_error("branching to an undefined basic block");
           return 0;
         }
-        cost->add_cost(CurrentMachine->machine_cost->SWITCH + bb.second);
-        update_cost_log(Switch, CurrentMachine->machine_cost->SWITCH, bb.second);
+        cost_acc += machine->machine_cost->SWITCH + bb.second;
+        wait_acc += bb.second;
+        log_block(stmt);
+        if (profile != nullptr) {
+          uint64_t value = stmt->get_cond().peek_value(regfile).first;
+          profile->add_wait(line, bb.second);
+          profile->resolve_async(regfile, line, cost_acc - machine->machine_cost->SWITCH - bb.second, bb.second);
+          profile->add_case(line, value);
+          if (profile->counts_values())
+            profile->add_value(line, 0, value);
+        }
         break;
       }
       case Call: {
-        if (is_oracle()) {
+        if (machine->machine_kind == Oracle) {
           invoke_runtime_error("call inside the oracle");
           return 0;
         }
 
-        auto stmt = dynamic_cast<StmtCall*>(curr);
-        string fname = stmt->get_fname();
-        Function* callee = program->get_function(fname);
+        auto stmt = static_cast<StmtCall*>(curr);
+        Function* callee = stmt->get_callee();
         if (callee == nullptr) {
           invoke_runtime_error("calling an undefined function");
           return 0;
         }
-        bool callee_is_oracle = is_oracle_function(fname);
+        bool callee_is_oracle = callee->is_oracle_function();
 
         int nargs = callee->get_nargs();
         if (nargs != stmt->get_nargs()) {
@@ -141,41 +219,116 @@ uint64_t State::exec_function(CostStack* parent, Function* function) {
           return 0;
         }
 
-        RegFile old = regfile;
+        if (frames.size() + 1 >= max_call_depth) {
+          invoke_runtime_error("exceeding the maximum call depth");
+          return 0;
+        }
+
+        RegMask saved = stmt->get_saved_regs();
+        frames.push_back(Frame { stmt, cost, 0, saved, regfile.get_nargs() });
+        push_saved_regs(saved, stmt->get_arg_regs());
 
         if (callee_is_oracle) {
-          switch_to_oracle();
+          machine = &OracleMachine;
         }
 
-        regfile.set_nargs(nargs);
-        double wait_cost = stmt->setup_args(cost->get_cost(), old, regfile);
-        double inst_cost = (callee_is_oracle ? (CurrentMachine->machine_cost->CALL_ORACLE) : (CurrentMachine->machine_cost->CALL));
-        inst_cost += nargs * CurrentMachine->machine_cost->PER_ARG;
-        cost->add_cost(inst_cost + wait_cost);
+        double wait_cost = stmt->setup_args(cost_acc, regfile);
+        double inst_cost = (callee_is_oracle ? (machine->machine_cost->CALL_ORACLE) : (machine->machine_cost->CALL));
+        inst_cost += nargs * machine->machine_cost->PER_ARG;
+        cost_acc += inst_cost + wait_cost;
         update_cost_log(Call, inst_cost, wait_cost);
-        uint64_t ret = exec_function(cost, callee);
-        regfile = old;
-        regfile.write_reg(curr->get_lhs(), ret);
+        if (profile != nullptr) {
+          profile->add_cost(line, inst_cost);
+          profile->add_wait(line, wait_cost);
+          profile->resolve_async(regfile, line, cost_acc - inst_cost - wait_cost, wait_cost);
+          profile->enter_call(line, cost_acc - inst_cost - wait_cost, saved, stmt->get_arg_regs());
+          if (profile->counts_values()) {
+            for (int i = 0; i < nargs; i++)
+              profile->add_value(line, i, regfile.peek_reg((Reg)((int)A1 + i)).first);
+          }
+        }
+        frames.back().cost_acc = cost_acc;
 
-        curr = stmt->get_next();
+        cost = cost_tree->enter(cost, callee);
+        cost_acc = 0;
+        curr = callee->get_first_bb();
+        if (curr == nullptr) {
+          invoke_runtime_error("missing first basic block");
+          return 0;
+        }
         break;
       }
       default: {
-        auto costs = curr->exec(cost->get_cost(), regfile, memory);
-        cost->add_cost(costs.first + costs.second);
-        update_cost_log(curr->get_opcode(), costs.first, costs.second);
+        // a divisor, and the address of an aload, are read before the result may overwrite them
+        bool async_heap = false;
+        if (profile != nullptr && opcode == Bop && profile->counts_values()) {
+          auto stmt = static_cast<StmtBop*>(curr);
+          if (stmt->get_bop_kind() == Udiv || stmt->get_bop_kind() == Urem)
+            profile->add_value(line, 0, stmt->get_val2().peek_value(regfile).first);
+        } else if (profile != nullptr && opcode == Load) {
+          auto stmt = static_cast<StmtLoad*>(curr);
+          if (stmt->get_is_async())
+            async_heap = is_heap(stmt->get_size(), stmt->get_ptr().peek_value(regfile).first + stmt->get_ofs());
+        }
+        auto costs = curr->exec(cost_acc, *machine, regfile, memory, io);
+        cost_acc += costs.first + costs.second;
+        wait_acc += costs.second;
+        if (opcode == Load || opcode == Store)
+          cost_per_inst[machine->machine_kind][opcode] += costs.first;
+        if (profile != nullptr) {
+          if (opcode == Load || opcode == Store)
+            profile->add_cost(line, costs.first);
+          profile->add_wait(line, costs.second);
+          double use = cost_acc - costs.first - costs.second;
+          profile->resolve_async(regfile, line, use, costs.second);
+          if (opcode == Load && static_cast<StmtLoad*>(curr)->get_is_async())
+            profile->issue_async(curr->get_lhs(), line, use, cost_acc, regfile.peek_reg(curr->get_lhs()).second, async_heap);
+          if (opcode == Load && profile->counts_values())
+            profile->add_value(line, 0, regfile.peek_reg(curr->get_lhs()).first);
+        }
         curr = curr->get_next();
       }
     }
   }
 }
 
-uint64_t State::exec_program() {
-  Function* main = program->get_function("main");
-  if (main == nullptr)
-    invoke_runtime_error("missing main function");
-  uint64_t res = exec_function(nullptr, main);
-  return res;
+/** runs main; ret is its return value, unless the returned status is an error */
+Status State::exec_program(uint64_t& ret) {
+  try {
+    Function* main = program->get_function("main");
+    if (main == nullptr)
+      invoke_runtime_error("missing main function");
+
+    cost_tree = new CostTree(cost_tree_kind, main);
+    if (profile_kind != ProfileNone)
+      profile = new Profile(*program, profile_kind);
+    if (engine == EngineBytecode) {
+      // lowered once per program, so batch jobs and server jobs share it
+      bool profiled = profile != nullptr;
+      bytecode = program->get_bytecode(profiled, [this, profiled](BytecodeProgram& lowered) {
+        bytecode = &lowered;
+        if (profiled) {
+          exec_bytecode<Normal, true>(nullptr, nullptr);
+          exec_bytecode<Oracle, true>(nullptr, nullptr);
+        } else {
+          exec_bytecode<Normal, false>(nullptr, nullptr);
+          exec_bytecode<Oracle, false>(nullptr, nullptr);
+        }
+      });
+      if (profiled)
+        ret = exec_bytecode<Normal, true>(bytecode->get_function(main), cost_tree->get_root());
+      else
+        ret = exec_bytecode<Normal, false>(bytecode->get_function(main), cost_tree->get_root());
+    } else {
+      ret = exec_function(main);
+    }
+  } catch (const Error& e) {
+    io.flush_output();
+    return Status(e.get_kind(), program->get_filename(), line, e.get_message());
+  }
+
+  io.flush_output();
+  return Status();
 }
 
 string State::inst_log_line(MachineKind machine, Opcode opcode, const string &machine_name, const string &inst) const {
@@ -6,49 +6,103 @@
 #include "regfile.h"
 #include "memory.h"
 #include "program.h"
+#include "bytecode.h"
 #include "opcode.h"
+#include "io.h"
+#include "error.h"
+#include "costtree.h"
+#include "profile.h"
 
 using namespace std;
 
+#define DEFAULT_MAX_CALL_DEPTH ((size_t)1000000)
 
-class CostStack {
-private:
-  string fname;
+
+/**
+ * a suspended caller. guest calls push a frame instead of recursing on the
+ * host stack, so the guest call depth is bounded only by max_call_depth.
+ * the caller's registers in saved sit on top of the state's save area.
+ */
+struct Frame {
+  Stmt* call;
+  CostNode* cost;
+  double cost_acc;
+  RegMask saved;
+  int nargs;
+};
+
+struct BytecodeFrame {
+  const Inst* call;
+  const BytecodeFunction* function;
+  CostNode* cost_node;
   double cost;
-  vector<CostStack*> callees;
+  RegMask saved;
+  int nargs;
+};
 
-public:
-  explicit CostStack(const string& _fname);
-  double get_cost() const;
-  void add_cost(double _cost);
-  void set_callee(CostStack* callee);
-  string to_string(const string& indent) const;
+
+enum EngineKind {
+  EngineTree = 0,
+  EngineBytecode
 };
 
 
+/**
+ * one run of a program. everything a run changes lives here, so States
+ * running on different threads share nothing but the (constant) Program.
+ */
 class State {
 private:
   RegFile regfile;
   Memory memory;
-  CostStack* main_cost;
+  GuestIO io;
+  const Machine* machine;
+  int line;
+  CostTreeKind cost_tree_kind;
+  CostTree* cost_tree;
+  ProfileKind profile_kind;
+  Profile* profile;
   double cost_per_inst[LEN_MACHINE][Opcode::LEN_OPCODE];
   int inst_count[LEN_MACHINE][Opcode::LEN_OPCODE];
   double total_wait_cost;
-  Program* program;
+  const Program* program;
+  EngineKind engine;
+  /** owned by the program */
+  BytecodeProgram* bytecode;
+  size_t max_call_depth;
+  vector<Frame> frames;
+  vector<BytecodeFrame> bytecode_frames;
+  vector<SavedReg> save_area;
+  size_t save_top;
 
-  uint64_t exec_function(CostStack* parent, Function* function);
+  uint64_t exec_function(const Function* function);
+  template <MachineKind M, bool P>
+  uint64_t exec_bytecode(const BytecodeFunction* function, CostNode* cost_node);
+  void push_saved_regs(RegMask mask, RegMask resolved);
+  void pop_saved_regs(RegMask mask);
   void update_cost_log(Opcode opcode, double inst_cost, double wait_cost);
+  void log_block(const StmtTerminator* stmt);
   string inst_log_line(MachineKind machine, Opcode opcode, const string &machine_name, const string &inst) const;
   string inst_log_machine(MachineKind machine, const string &machine_name) const;
 
 public:
   State();
+  /** a run reading the guest's input from in_fd and writing its output to out */
+  State(int _in_fd, FILE* _out);
+  ~State();
+  State(const State&) = delete;
+  State& operator=(const State&) = delete;
 
-  void set_program(Program* _program);
+  void set_program(const Program* _program);
+  void set_engine(EngineKind _engine);
+  void set_max_call_depth(size_t _max_call_depth);
+  void set_cost_tree(CostTreeKind _cost_tree_kind);
+  void set_profile(ProfileKind _profile_kind);
   double get_cost_value() const;
-  CostStack* get_cost() const;
+  const CostTree* get_cost_tree() const;
+  const Profile* get_profile() const;
   uint64_t get_max_alloced_size() const;
-  uint64_t exec_program();
+  Status exec_program(uint64_t& ret);
   string inst_log_to_string() const;
   double get_total_wait_cost() const;
 };
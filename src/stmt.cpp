@@ -1,6 +1,6 @@
-#include <iostream>
-
 #include "stmt.h"
+#include "program.h"
+#include "alu.h"
 #include "error.h"
 
 
@@ -8,86 +8,151 @@ Stmt::Stmt(int _line, Reg _lhs, Opcode _opcode): line(_line), lhs(_lhs), opcode(
 
 int Stmt::get_line() const { return line; }
 
-Reg Stmt::get_lhs() const { return lhs; }
+Reg Stmt::get_lhs() const { return (Reg)lhs; }
 
-Opcode Stmt::get_opcode() const { return opcode; }
+Opcode Stmt::get_opcode() const { return (Opcode)opcode; }
 
 Stmt *Stmt::get_next() const { return next; }
 
 void Stmt::set_next(Stmt *stmt) { next = stmt; }
 
+void Stmt::link(const Function &function, const Program &program) {}
+
+RegMask Stmt::get_clobbered_regs() const { return reg_mask(get_lhs()); }
+
 double get_wait_cost(double cost_acc, double wait_until) {
   return cost_acc >= wait_until ? 0 : wait_until - cost_acc;
 }
 
 
+/** the cost of stmt on a machine with costs mc when it is the same on every run, or 0 */
+double fixed_cost_of(const Stmt* stmt, const Cost& mc) {
+  switch (stmt->get_opcode()) {
+    case Ret: return mc.RET;
+    case BrUncond: return mc.BRUNCOND;
+    case Switch: return mc.SWITCH;
+    case Malloc: return mc.MALLOC;
+    case Free: return mc.FREE;
+    case Bop: return cost_of(mc, static_cast<const StmtBop*>(stmt)->get_bop_kind());
+    case Sum: return mc.SUM;
+    case Uop: return mc.UOP;
+    case Select: return mc.TERNARY;
+    case Assert: return mc.ASSERT;
+    case Read: return mc.CALL;
+    case Write: return mc.CALL + mc.PER_ARG;
+    // a branch costs by its outcome, and a load or a store by its address
+    default: return 0;
+  }
+}
+
+
 /** terminators */
 
-StmtRet::StmtRet(int _line, Value _val): Stmt(_line, RegNone, Ret), val(_val) {}
+StmtTerminator::StmtTerminator(int _line, Opcode _opcode): Stmt(_line, RegNone, _opcode) {}
+
+void StmtTerminator::set_block_costs(const BlockCost* _block_costs, int _nblock_costs) {
+  block_costs = _block_costs;
+  nblock_costs = _nblock_costs;
+}
+
+StmtRet::StmtRet(int _line, Value _val): StmtTerminator(_line, Ret), val(_val) {}
+
+const Value& StmtRet::get_val() const { return val; }
 
 pair<uint64_t, double> StmtRet::get_val(double cost_acc, RegFile &regfile) const {
   auto ret = val.get_value(regfile);
   return make_pair(ret.first, get_wait_cost(cost_acc, ret.second));
 }
 
-pair<double, double> StmtRet::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+RegMask StmtRet::get_clobbered_regs() const {
+  return val.get_clobbered_regs();
+}
+
+pair<double, double> StmtRet::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   return make_pair(0, 0);
 }
 
-StmtBrUncond::StmtBrUncond(int _line, string _bb): Stmt(_line, RegNone, BrUncond), bb(move(_bb)) {}
+StmtBrUncond::StmtBrUncond(int _line, string_view _bb): StmtTerminator(_line, BrUncond), bb(_bb) {}
 
-string StmtBrUncond::get_bb() const { return bb; }
+Stmt* StmtBrUncond::get_bb() const { return bb_stmt; }
 
-pair<double, double> StmtBrUncond::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+/** sets the target directly, for a statement built without its label */
+void StmtBrUncond::resolve(Stmt* _bb_stmt) { bb_stmt = _bb_stmt; }
+
+void StmtBrUncond::link(const Function &function, const Program &program) {
+  resolve(function.get_bb(bb));
+}
+
+pair<double, double> StmtBrUncond::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   return make_pair(0, 0);
 }
 
-StmtBrCond::StmtBrCond(int _line, Value _cond, string _true_bb, string _false_bb):
-Stmt(_line, RegNone, BrCond), cond(_cond), true_bb(move(_true_bb)), false_bb(move(_false_bb)) {}
+StmtBrCond::StmtBrCond(int _line, Value _cond, string_view _true_bb, string_view _false_bb):
+StmtTerminator(_line, BrCond), cond(_cond), true_bb(_true_bb), false_bb(_false_bb) {}
+
+const Value& StmtBrCond::get_cond() const { return cond; }
+
+Stmt* StmtBrCond::get_true_bb() const { return true_stmt; }
+
+Stmt* StmtBrCond::get_false_bb() const { return false_stmt; }
 
-pair<string, double> StmtBrCond::get_bb(double cost_acc, RegFile& regfile) {
+/** eval tells which way the branch went; the statement itself is left alone */
+pair<Stmt*, double> StmtBrCond::get_bb(double cost_acc, RegFile& regfile, bool& eval) const {
   auto c = cond.get_value(regfile);
-  if (c.first != 0) {
-    eval = true;
-    return make_pair(true_bb, get_wait_cost(cost_acc, c.second));
-  } else {
-    eval = false;
-    return make_pair(false_bb, get_wait_cost(cost_acc, c.second));
-  }
+  eval = c.first != 0;
+  return make_pair(eval ? true_stmt : false_stmt, get_wait_cost(cost_acc, c.second));
 }
 
-bool StmtBrCond::get_eval() const { return eval; }
+void StmtBrCond::resolve(Stmt* _true_stmt, Stmt* _false_stmt) {
+  true_stmt = _true_stmt;
+  false_stmt = _false_stmt;
+}
 
-pair<double, double> StmtBrCond::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
-  return make_pair(0, 0);
+void StmtBrCond::link(const Function &function, const Program &program) {
+  resolve(function.get_bb(true_bb), function.get_bb(false_bb));
 }
 
-StmtSwitch::StmtSwitch(int _line, Value _cond): Stmt(_line, RegNone, Switch), cond(_cond) {}
+RegMask StmtBrCond::get_clobbered_regs() const {
+  return cond.get_clobbered_regs();
+}
 
-bool StmtSwitch::set_bb(uint64_t val, string bb) {
-  auto it = bb_map.find(val);
-  if (it != bb_map.end())
-    return false;
-  bb_map.insert(pair<uint64_t, string>(val, move(bb)));
-  return true;
+pair<double, double> StmtBrCond::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
+  return make_pair(0, 0);
 }
 
-pair<string, double> StmtSwitch::get_bb(double cost_acc, RegFile& regfile) const {
+/** cases are sorted by value, their targets set on linking, which finds them by case_bbs */
+StmtSwitch::StmtSwitch(int _line, Value _cond, ArenaArray<pair<uint64_t, Stmt*>> _cases, const string_view* _case_bbs,
+                       string_view _default_bb):
+StmtTerminator(_line, Switch), cond(_cond), cases(_cases), case_bbs(_case_bbs), default_bb(_default_bb) {}
+
+const Value& StmtSwitch::get_cond() const { return cond; }
+
+const ArenaArray<pair<uint64_t, Stmt*>>& StmtSwitch::get_cases() const { return cases; }
+
+Stmt* StmtSwitch::get_default_bb() const { return default_stmt; }
+
+pair<Stmt*, double> StmtSwitch::get_bb(double cost_acc, RegFile& regfile) const {
   auto c = cond.get_value(regfile);
-  auto it = bb_map.find(c.first);
-  if (it == bb_map.end())
-    return make_pair(default_bb, get_wait_cost(cost_acc, c.second));
-  return make_pair(it->second, get_wait_cost(cost_acc, c.second));
+  return make_pair(table.lookup(c.first), get_wait_cost(cost_acc, c.second));
 }
 
-void StmtSwitch::set_default(string bb) { default_bb = move(bb); }
+/** sets the default target directly; the cases must hold their targets already */
+void StmtSwitch::resolve(Stmt* _default_stmt) {
+  default_stmt = _default_stmt;
+  table.build(cases, default_stmt);
+}
 
-bool StmtSwitch::case_exists(uint64_t val) const {
-  auto it = bb_map.find(val);
-  return it != bb_map.end();
+void StmtSwitch::link(const Function &function, const Program &program) {
+  for (size_t i = 0; i < cases.size(); i++)
+    cases[i].second = function.get_bb(case_bbs[i]);
+  resolve(function.get_bb(default_bb));
 }
 
-pair<double, double> StmtSwitch::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+RegMask StmtSwitch::get_clobbered_regs() const {
+  return cond.get_clobbered_regs();
+}
+
+pair<double, double> StmtSwitch::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   return make_pair(0, 0);
 }
 
@@ -96,38 +161,62 @@ pair<double, double> StmtSwitch::exec(double cost_acc, RegFile &regfile, Memory
 
 StmtMalloc::StmtMalloc(int _line, Reg _lhs, Value _val): Stmt(_line, _lhs, Malloc), val(_val) {}
 
-pair<double, double> StmtMalloc::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+const Value& StmtMalloc::get_val() const { return val; }
+
+RegMask StmtMalloc::get_clobbered_regs() const {
+  return reg_mask(get_lhs()) | val.get_clobbered_regs();
+}
+
+pair<double, double> StmtMalloc::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto size = val.get_value(regfile);
   uint64_t addr;
-  double cost = memory.exec_malloc(size.first, addr);
+  double cost = memory.exec_malloc(machine, size.first, addr);
   regfile.write_reg(get_lhs(), addr);
   return make_pair(cost, get_wait_cost(cost_acc, size.second));
 }
 
 StmtFree::StmtFree(int _line, Value _ptr): Stmt(_line, RegNone, Free), ptr(_ptr) {}
 
-pair<double, double> StmtFree::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+const Value& StmtFree::get_ptr() const { return ptr; }
+
+RegMask StmtFree::get_clobbered_regs() const {
+  return ptr.get_clobbered_regs();
+}
+
+pair<double, double> StmtFree::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto addr = ptr.get_value(regfile);
-  return make_pair(memory.exec_free(addr.first), get_wait_cost(cost_acc, addr.second));
+  return make_pair(memory.exec_free(machine, addr.first), get_wait_cost(cost_acc, addr.second));
 }
 
 StmtLoad::StmtLoad(int _line, Reg _lhs, bool _is_async, MSize _size, Value _ptr, uint64_t _ofs):
 Stmt(_line, _lhs, Load), is_async(_is_async), size(_size), ptr(_ptr), ofs(_ofs) {}
 
-pair<double, double> StmtLoad::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+bool StmtLoad::get_is_async() const { return is_async; }
+
+MSize StmtLoad::get_size() const { return size; }
+
+const Value& StmtLoad::get_ptr() const { return ptr; }
+
+uint64_t StmtLoad::get_ofs() const { return ofs; }
+
+RegMask StmtLoad::get_clobbered_regs() const {
+  return reg_mask(get_lhs()) | ptr.get_clobbered_regs();
+}
+
+pair<double, double> StmtLoad::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto res = ptr.get_value(regfile);
   uint64_t addr = res.first + ofs;
   uint64_t result;
-  double cost = memory.exec_load(is_async, size, addr, result);
+  double cost = memory.exec_load(machine, is_async, size, addr, result);
   double wait_cost = get_wait_cost(cost_acc, res.second);
   regfile.write_reg(get_lhs(), result);
 
   if (is_async) {
     if (is_stack(size, addr)) {
-      regfile.set_async(get_lhs(), cost_acc + wait_cost + CurrentMachine->machine_cost->ALOAD + CurrentMachine->machine_cost->WAIT_STACK);
+      regfile.set_async(get_lhs(), cost_acc + wait_cost + machine.machine_cost->ALOAD + machine.machine_cost->WAIT_STACK);
     }
     else if (is_heap(size,addr)) {
-      regfile.set_async(get_lhs(), cost_acc + wait_cost + CurrentMachine->machine_cost->ALOAD + CurrentMachine->machine_cost->WAIT_HEAP);
+      regfile.set_async(get_lhs(), cost_acc + wait_cost + machine.machine_cost->ALOAD + machine.machine_cost->WAIT_HEAP);
     }
     else
       invoke_runtime_error("accessing address between 10248 and 20480");
@@ -139,300 +228,73 @@ pair<double, double> StmtLoad::exec(double cost_acc, RegFile &regfile, Memory &m
 StmtStore::StmtStore(int _line, MSize _size, Value _val, Value _ptr, uint64_t _ofs):
 Stmt(_line, RegNone, Store), size(_size), val(_val), ptr(_ptr), ofs(_ofs) {}
 
-pair<double, double> StmtStore::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+MSize StmtStore::get_size() const { return size; }
+
+const Value& StmtStore::get_val() const { return val; }
+
+const Value& StmtStore::get_ptr() const { return ptr; }
+
+uint64_t StmtStore::get_ofs() const { return ofs; }
+
+RegMask StmtStore::get_clobbered_regs() const {
+  return val.get_clobbered_regs() | ptr.get_clobbered_regs();
+}
+
+pair<double, double> StmtStore::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto res = ptr.get_value(regfile);
   uint64_t addr = res.first + ofs;
   auto v = val.get_value(regfile);
   double wait_cost = max(get_wait_cost(cost_acc, res.second), get_wait_cost(cost_acc, v.second));
-  return make_pair(memory.exec_store(size, addr, v.first), wait_cost);
+  return make_pair(memory.exec_store(machine, size, addr, v.first), wait_cost);
 }
 
 
 /** binary operations */
 
 StmtBop::StmtBop(int _line, Reg _lhs, BopKind _bop_kind, Value _val1, Value _val2, Size _size):
-Stmt(_line, _lhs, Bop), bop_kind(_bop_kind), val1(_val1), val2(_val2), size(_size) {}
-
-bool is_signed_op(BopKind bop_kind) {
-  switch(bop_kind) {
-    case Udiv:
-    case Urem:
-    case Mul:
-    case Shl:
-    case Lshr:
-    case And:
-    case Or:
-    case Xor:
-    case Add:
-    case Sub:
-    case Eq:
-    case Ne:
-    case Ugt:
-    case Uge:
-    case Ult:
-    case Ule:
-      return false;
-    case Ashr:
-    case Sdiv:
-    case Srem:
-    case Sgt:
-    case Sge:
-    case Slt:
-    case Sle:
-      return true;
-  }
-}
+Stmt(_line, _lhs, Bop), val1(_val1), val2(_val2), bop_kind(_bop_kind), size(_size),
+kernel(get_bop_kernel(_bop_kind, _size)) {}
 
-bool is_shift_op(BopKind bop_kind) {
-  switch(bop_kind) {
-    case Shl:
-    case Lshr:
-    case Ashr:
-      return true;
-    default:
-      return false;
-  }
-}
+BopKind StmtBop::get_bop_kind() const { return bop_kind; }
 
-uint64_t get_op1(BopKind bop_kind, Size size, uint64_t val) {
-  if (is_signed_op(bop_kind)) {
-    switch (size) {
-      case Size1:
-        if (val % 2 == 1)
-          return -1;
-        else
-          return 0;
-      case Size8:
-        return (int8_t)val;
-      case Size16:
-        return (int16_t)val;
-      case Size32:
-        return (int32_t)val;
-      case Size64:
-        return val;
-    }
-  }
-  else {
-    switch (size) {
-      case Size1:
-        if (val % 2 == 1)
-          return 1;
-        else
-          return 0;
-      case Size8:
-        return (uint8_t)val;
-      case Size16:
-        return (uint16_t)val;
-      case Size32:
-        return (uint32_t)val;
-      case Size64:
-        return val;
-    }
-  }
-}
+const Value& StmtBop::get_val1() const { return val1; }
 
-uint64_t get_op2(BopKind bop_kind, Size size, uint64_t val) {
-  if (is_shift_op(bop_kind)) {
-    return val % bw_of(size);
-  }
+const Value& StmtBop::get_val2() const { return val2; }
 
-  return get_op1(bop_kind, size, val);
-}
-
-uint64_t get_result(Size size, uint64_t val) {
-  switch (size) {
-    case Size1:
-      return val % 2;
-    case Size8:
-      return (uint8_t)val;
-    case Size16:
-      return (uint16_t)val;
-    case Size32:
-      return (uint32_t)val;
-    case Size64:
-      return val;
-  }
-}
+Size StmtBop::get_size() const { return size; }
 
-uint64_t StmtBop::compute(uint64_t op1, uint64_t op2) const {
-  op1 = get_op1(bop_kind, size, op1);
-  op2 = get_op2(bop_kind, size, op2);
-  uint64_t result = 0;
-
-  switch (bop_kind) {
-    case Udiv:
-      if (op2 == 0) {
-        invoke_runtime_error("division by zero");
-        return 0;
-      }
-      result = op1 / op2;
-      break;
-    case Sdiv:
-      if (op2 == 0) {
-        invoke_runtime_error("division by zero");
-        return 0;
-      }
-      result = (int64_t) op1 / (int64_t) op2;
-      break;
-    case Urem:
-      if (op2 == 0) {
-        invoke_runtime_error("division by zero");
-        return 0;
-      }
-      result = op1 % op2;
-      break;
-    case Srem:
-      if (op2 == 0) {
-        invoke_runtime_error("division by zero");
-        return 0;
-      }
-      result = (int64_t) op1 % (int64_t) op2;
-      break;
-    case Mul:
-      result = op1 * op2;
-      break;
-    case Shl:
-      result = op1 << op2;
-      break;
-    case Lshr:
-      result = op1 >> op2;
-      break;
-    case Ashr:
-      result = (int64_t) op1 >> op2;
-      break;
-    case And:
-      result = op1 & op2;
-      break;
-    case Or:
-      result = op1 | op2;
-      break;
-    case Xor:
-      result = op1 ^ op2;
-      break;
-    case Add:
-      result = op1 + op2;
-      break;
-    case Sub:
-      result = op1 - op2;
-      break;
-    case Eq:
-      if (op1 == op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Ne:
-      if (op1 != op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Ugt:
-      if (op1 > op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Uge:
-      if (op1 >= op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Ult:
-      if (op1 < op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Ule:
-      if (op1 <= op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Sgt:
-      if ((int64_t) op1 > (int64_t) op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Sge:
-      if ((int64_t) op1 >= (int64_t) op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Slt:
-      if ((int64_t) op1 < (int64_t) op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-    case Sle:
-      if ((int64_t) op1 <= (int64_t) op2)
-        result = 1;
-      else
-        result = 0;
-      break;
-  }
-
-  return get_result(size, result);
-}
-
-double cost_of(BopKind bop_kind) {
-  switch (bop_kind) {
-    case Udiv:
-    case Sdiv:
-    case Urem:
-    case Srem:
-    case Mul:
-      return CurrentMachine->machine_cost->MULDIV;
-    case Shl:
-    case Lshr:
-    case Ashr:
-    case And:
-    case Or:
-    case Xor:
-      return CurrentMachine->machine_cost->LOGICAL;
-    case Add:
-    case Sub:
-      return CurrentMachine->machine_cost->ADDSUB;
-    case Eq:
-    case Ne:
-    case Ugt:
-    case Uge:
-    case Ult:
-    case Ule:
-    case Sgt:
-    case Sge:
-    case Slt:
-    case Sle:
-      return CurrentMachine->machine_cost->COMP;
-  }
+RegMask StmtBop::get_clobbered_regs() const {
+  return reg_mask(get_lhs()) | val1.get_clobbered_regs() | val2.get_clobbered_regs();
 }
 
-pair<double, double> StmtBop::exec(double cost_acc, RegFile& regfile, Memory& memory) const {
+pair<double, double> StmtBop::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto op1 = val1.get_value(regfile);
   auto op2 = val2.get_value(regfile);
-  uint64_t res = compute(op1.first, op2.first);
+  uint64_t res = kernel(op1.first, op2.first);
   regfile.write_reg(get_lhs(), res);
   double wait_cost = max(get_wait_cost(cost_acc, op1.second), get_wait_cost(cost_acc, op2.second));
-  return make_pair(cost_of(bop_kind), wait_cost);
+  return make_pair(cost_of(*machine.machine_cost, bop_kind), wait_cost);
 }
 
 
 /** sum operation */
 
-StmtSum::StmtSum(int _line, Reg _lhs, const vector<Value> &_values, Size _size):
-Stmt(_line, _lhs, Sum), size(_size) {
-  values.reserve(num_operands);
-  for (int i = 0; i < num_operands; i++) {
-    values.emplace_back(_values.at(i));
-  }
+/** values has num_operands values */
+StmtSum::StmtSum(int _line, Reg _lhs, ArenaArray<Value> _values, Size _size):
+Stmt(_line, _lhs, Sum), values(_values), size(_size) {}
+
+const ArenaArray<Value>& StmtSum::get_values() const { return values; }
+
+Size StmtSum::get_size() const { return size; }
+
+RegMask StmtSum::get_clobbered_regs() const {
+  RegMask mask = reg_mask(get_lhs());
+  for (auto& val: values)
+    mask |= val.get_clobbered_regs();
+  return mask;
 }
 
-pair<double, double> StmtSum::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+pair<double, double> StmtSum::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   uint64_t res = 0;
   double wait_until = -1.0;
   for (auto value: values) {
@@ -442,25 +304,30 @@ pair<double, double> StmtSum::exec(double cost_acc, RegFile &regfile, Memory &me
       wait_until = v.second;
   }
   regfile.write_reg(get_lhs(), res);
-  return make_pair(CurrentMachine->machine_cost->SUM, get_wait_cost(cost_acc, wait_until));
+  return make_pair(machine.machine_cost->SUM, get_wait_cost(cost_acc, wait_until));
 }
 
 
 /** unary operations */
 
 StmtUop::StmtUop(int _line, Reg _lhs, UopKind _uop_kind, Value _val, Size _size):
-Stmt(_line, _lhs, Uop), uop_kind(_uop_kind), val(_val), size(_size) {}
+Stmt(_line, _lhs, Uop), val(_val), uop_kind(_uop_kind), size(_size), kernel(get_uop_kernel(_uop_kind, _size)) {}
 
-pair<double, double> StmtUop::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+UopKind StmtUop::get_uop_kind() const { return uop_kind; }
+
+const Value& StmtUop::get_val() const { return val; }
+
+Size StmtUop::get_size() const { return size; }
+
+RegMask StmtUop::get_clobbered_regs() const {
+  return reg_mask(get_lhs()) | val.get_clobbered_regs();
+}
+
+pair<double, double> StmtUop::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto op = val.get_value(regfile);
-  uint64_t res = op.first;
-  if (uop_kind == UopKind::Incr)
-    res++;
-  else
-    res--;
-  res = get_result(size, res);
+  uint64_t res = kernel(op.first);
   regfile.write_reg(get_lhs(), res);
-  return make_pair(CurrentMachine->machine_cost->UOP, get_wait_cost(cost_acc, op.second));
+  return make_pair(machine.machine_cost->UOP, get_wait_cost(cost_acc, op.second));
 }
 
 
@@ -469,7 +336,18 @@ pair<double, double> StmtUop::exec(double cost_acc, RegFile &regfile, Memory &me
 StmtSelect::StmtSelect(int _line, Reg _lhs, Value _cond, Value _val_true, Value _val_false):
 Stmt(_line, _lhs, Select), cond(_cond), val_true(_val_true), val_false(_val_false) {}
 
-pair<double, double> StmtSelect::exec(double cost_acc, RegFile& regfile, Memory& memory) const {
+const Value& StmtSelect::get_cond() const { return cond; }
+
+const Value& StmtSelect::get_val_true() const { return val_true; }
+
+const Value& StmtSelect::get_val_false() const { return val_false; }
+
+RegMask StmtSelect::get_clobbered_regs() const {
+  return reg_mask(get_lhs()) | cond.get_clobbered_regs() | val_true.get_clobbered_regs() |
+         val_false.get_clobbered_regs();
+}
+
+pair<double, double> StmtSelect::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto v_cond = cond.get_value(regfile);
   auto v_true = val_true.get_value(regfile);
   auto v_false = val_false.get_value(regfile);
@@ -487,35 +365,67 @@ pair<double, double> StmtSelect::exec(double cost_acc, RegFile& regfile, Memory&
     regfile.write_reg(get_lhs(), v_false.first);
   }
 
-  return make_pair(CurrentMachine->machine_cost->TERNARY, get_wait_cost(cost_acc, wait_until));
+  return make_pair(machine.machine_cost->TERNARY, get_wait_cost(cost_acc, wait_until));
 }
 
 
 /** function call */
 
-StmtCall::StmtCall(int _line, Reg _lhs, string _fname): Stmt(_line, _lhs, Call), fname(move(_fname)) {}
+StmtCall::StmtCall(int _line, Reg _lhs, string_view _fname, ArenaArray<Value> _args):
+Stmt(_line, _lhs, Call), fname(_fname), args(_args) {
+  for (auto& arg: args)
+    arg_regs |= arg.get_clobbered_regs();
+}
+
+const ArenaArray<Value>& StmtCall::get_args() const { return args; }
+
+string_view StmtCall::get_fname() const { return fname; }
 
-string StmtCall::get_fname() const { return fname; }
+Function* StmtCall::get_callee() const { return callee; }
 
-void StmtCall::push_arg(const Value arg) { args.push_back(arg); }
+int StmtCall::get_nargs() const { return args.size(); }
 
-int StmtCall::get_nargs() { return args.size(); }
+RegMask StmtCall::get_arg_regs() const { return arg_regs; }
 
-double StmtCall::setup_args(double cost_acc, RegFile &old, RegFile &regfile) {
+/**
+ * the caller state a call has to save: whatever the callee may clobber, the
+ * argument registers it sets up, and the registers it reads its arguments
+ * from (whose async loads the caller sees resolved after the call)
+ */
+RegMask StmtCall::get_saved_regs() const {
+  return callee->get_clobbered_regs() | arg_reg_mask(args.size()) | arg_regs;
+}
+
+/** arguments are all read from the caller's registers before any of them is set */
+double StmtCall::setup_args(double cost_acc, RegFile &regfile) const {
+  uint64_t vals[NARGREGS];
   double wait_until = - 1.0;
-  int r = (int)A1;
-  for (auto it: args) {
-    auto val = it.get_value(old);
-    regfile.set_value((Reg)r, val.first);
+  int n = 0;
+  for (auto& it: args) {
+    auto val = it.peek_value(regfile);
+    vals[n++] = val.first;
     if (val.second > wait_until)
       wait_until = val.second;
-    r++;
   }
 
+  regfile.set_nargs(n);
+  for (int i = 0; i < n; i++)
+    regfile.set_value((Reg)((int)A1 + i), vals[i]);
+
   return get_wait_cost(cost_acc, get_wait_cost(cost_acc, wait_until));
 }
 
-pair<double, double> StmtCall::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+void StmtCall::resolve(Function* _callee) { callee = _callee; }
+
+void StmtCall::link(const Function &function, const Program &program) {
+  resolve(program.get_function(fname));
+}
+
+RegMask StmtCall::get_clobbered_regs() const {
+  return reg_mask(get_lhs()) | arg_regs | arg_reg_mask(args.size());
+}
+
+pair<double, double> StmtCall::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   return make_pair(0, 0);
 }
 
@@ -525,13 +435,21 @@ pair<double, double> StmtCall::exec(double cost_acc, RegFile &regfile, Memory &m
 StmtAssert::StmtAssert(int _line, Value _op1, Value _op2):
 Stmt(_line, RegNone, Assert), op1(_op1), op2(_op2){}
 
-pair<double, double> StmtAssert::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+const Value& StmtAssert::get_op1() const { return op1; }
+
+const Value& StmtAssert::get_op2() const { return op2; }
+
+RegMask StmtAssert::get_clobbered_regs() const {
+  return op1.get_clobbered_regs() | op2.get_clobbered_regs();
+}
+
+pair<double, double> StmtAssert::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto val1 = op1.get_value(regfile);
   auto val2 = op2.get_value(regfile);
   double wait_until = max(val1.second, val2.second);
 
   if (val1.first == val2.first)
-    return make_pair(CurrentMachine->machine_cost->ASSERT, get_wait_cost(cost_acc, wait_until));
+    return make_pair(machine.machine_cost->ASSERT, get_wait_cost(cost_acc, wait_until));
 
   invoke_assertion_failed(regfile);
   return make_pair(0, 0);
@@ -542,25 +460,27 @@ pair<double, double> StmtAssert::exec(double cost_acc, RegFile &regfile, Memory
 
 StmtRead::StmtRead(int _line, Reg _lhs): Stmt(_line, _lhs, Read) {}
 
-pair<double, double> StmtRead::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
-  string input;
-  cin >> input;
-
-  try {
-    uint64_t result = stoull(input);
-    regfile.write_reg(get_lhs(), result);
-    return make_pair(CurrentMachine->machine_cost->CALL, 0);
-  } catch (exception& e) {
+pair<double, double> StmtRead::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
+  uint64_t result;
+  if (!io.read_input(result)) {
     invoke_runtime_error("invalid input");
     return make_pair(0, 0);
   }
+  regfile.write_reg(get_lhs(), result);
+  return make_pair(machine.machine_cost->CALL, 0);
 }
 
 StmtWrite::StmtWrite(int _line, Reg _lhs, Value _val): Stmt(_line, _lhs, Write), val(_val) {}
 
-pair<double, double> StmtWrite::exec(double cost_acc, RegFile &regfile, Memory &memory) const {
+const Value& StmtWrite::get_val() const { return val; }
+
+RegMask StmtWrite::get_clobbered_regs() const {
+  return reg_mask(get_lhs()) | val.get_clobbered_regs();
+}
+
+pair<double, double> StmtWrite::exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const {
   auto result = val.get_value(regfile);
-  cout << result.first << endl;
+  io.write_output(result.first);
   regfile.write_reg(get_lhs(), 0);
-  return make_pair(CurrentMachine->machine_cost->CALL + CurrentMachine->machine_cost->PER_ARG, get_wait_cost(cost_acc, result.second));
+  return make_pair(machine.machine_cost->CALL + machine.machine_cost->PER_ARG, get_wait_cost(cost_acc, result.second));
 }
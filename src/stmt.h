@@ -1,23 +1,34 @@
 #ifndef SWPP_ASM_INTERPRETER_STMT_H
 #define SWPP_ASM_INTERPRETER_STMT_H
 
-#include <string>
-#include <map>
+#include <string_view>
 #include <utility>
 
 #include "opcode.h"
 #include "value.h"
 #include "size.h"
 #include "memory.h"
+#include "io.h"
+#include "jumptable.h"
+#include "alu.h"
+#include "arena.h"
 
 using namespace std;
 
+class Function;
+class Program;
 
+
+/**
+ * statements are placed in the arena of their program and never destroyed,
+ * so they hold no memory of their own: names are interned in the program,
+ * and operand lists are arrays in its arena
+ */
 class Stmt {
 private:
   const int line;
-  const Reg lhs;
-  const Opcode opcode;
+  const uint8_t lhs;
+  const uint8_t opcode;
   Stmt* next;
 
 public:
@@ -29,63 +40,117 @@ public:
   Stmt* get_next() const;
   void set_next(Stmt* stmt);
 
-  virtual pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const = 0;
+  virtual void link(const Function& function, const Program& program);
+  /** registers whose value or pending async load executing this may change */
+  virtual RegMask get_clobbered_regs() const;
+  virtual pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const = 0;
 };
 
+double fixed_cost_of(const Stmt* stmt, const Cost& mc);
+
 
 /** terminators */
 
-class StmtRet: public Stmt {
+/**
+ * what a block logs for one opcode whichever way it runs: the count of its
+ * statements but calls, and their cost when it is fixed (see Function::link)
+ */
+struct BlockCost {
+  Opcode opcode;
+  int count;
+  double cost;
+};
+
+/** a terminator logs what its block does on every run, once it has run it */
+class StmtTerminator: public Stmt {
+private:
+  const BlockCost* block_costs = nullptr;
+  int nblock_costs = 0;
+
+public:
+  StmtTerminator(int _line, Opcode _opcode);
+
+  const BlockCost* get_block_costs() const;
+  int get_nblock_costs() const;
+  void set_block_costs(const BlockCost* _block_costs, int _nblock_costs);
+};
+
+/** read at the end of every block the statement engine runs */
+
+inline const BlockCost* StmtTerminator::get_block_costs() const { return block_costs; }
+
+inline int StmtTerminator::get_nblock_costs() const { return nblock_costs; }
+
+class StmtRet: public StmtTerminator {
 private:
   const Value val;
 
 public:
   explicit StmtRet(int _line, Value _val);
 
+  const Value& get_val() const;
   pair<uint64_t, double> get_val(double cost_acc, RegFile &regfile) const;
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
-class StmtBrUncond: public Stmt {
+class StmtBrUncond: public StmtTerminator {
 private:
-  const string bb;
+  const string_view bb;
+  Stmt* bb_stmt = nullptr;
 
 public:
-  explicit StmtBrUncond(int _line, string _bb);
+  explicit StmtBrUncond(int _line, string_view _bb);
 
-  string get_bb() const;
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  Stmt* get_bb() const;
+  void resolve(Stmt* _bb_stmt);
+  void link(const Function& function, const Program& program) override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
-class StmtBrCond: public Stmt {
+class StmtBrCond: public StmtTerminator {
 private:
   const Value cond;
-  const string true_bb;
-  const string false_bb;
-  bool eval = true;
+  const string_view true_bb;
+  const string_view false_bb;
+  Stmt* true_stmt = nullptr;
+  Stmt* false_stmt = nullptr;
 
 public:
-  StmtBrCond(int _line, Value _cond, string _true_bb, string _false_bb);
-
-  pair<string, double> get_bb(double cost_acc, RegFile& regfile);
-  bool get_eval() const;
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  StmtBrCond(int _line, Value _cond, string_view _true_bb, string_view _false_bb);
+
+  const Value& get_cond() const;
+  Stmt* get_true_bb() const;
+  Stmt* get_false_bb() const;
+  pair<Stmt*, double> get_bb(double cost_acc, RegFile& regfile, bool& eval) const;
+  void resolve(Stmt* _true_stmt, Stmt* _false_stmt);
+  void link(const Function& function, const Program& program) override;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
-class StmtSwitch: public Stmt {
+/** the one statement that owns memory (its jump table), so the arena destroys it */
+class StmtSwitch: public StmtTerminator {
 private:
   const Value cond;
-  map<uint64_t, string> bb_map;
-  string default_bb;
+  const ArenaArray<pair<uint64_t, Stmt*>> cases;
+  const string_view* const case_bbs;
+  const string_view default_bb;
+  Stmt* default_stmt = nullptr;
+  JumpTable<Stmt*> table;
 
 public:
-  explicit StmtSwitch(int _line, Value _cond);
-
-  bool set_bb(uint64_t val, string bb);
-  void set_default(string bb);
-  bool case_exists(uint64_t val) const;
-  pair<string, double> get_bb(double cost_acc, RegFile& regfile) const;
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  StmtSwitch(int _line, Value _cond, ArenaArray<pair<uint64_t, Stmt*>> _cases, const string_view* _case_bbs,
+             string_view _default_bb);
+
+  const Value& get_cond() const;
+  const ArenaArray<pair<uint64_t, Stmt*>>& get_cases() const;
+  Stmt* get_default_bb() const;
+  pair<Stmt*, double> get_bb(double cost_acc, RegFile& regfile) const;
+  void resolve(Stmt* _default_stmt);
+  void link(const Function& function, const Program& program) override;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 
@@ -98,7 +163,9 @@ private:
 public:
   StmtMalloc(int _line, Reg _lhs, Value _val);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  const Value& get_val() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 class StmtFree: public Stmt {
@@ -108,7 +175,9 @@ private:
 public:
   explicit StmtFree(int _line, Value _ptr);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  const Value& get_ptr() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 class StmtLoad: public Stmt {
@@ -121,7 +190,12 @@ private:
 public:
   StmtLoad(int _line, Reg _lhs, bool _is_async, MSize _size, Value _ptr, uint64_t _ofs);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  bool get_is_async() const;
+  MSize get_size() const;
+  const Value& get_ptr() const;
+  uint64_t get_ofs() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 class StmtStore: public Stmt {
@@ -134,7 +208,12 @@ private:
 public:
   StmtStore(int _line, MSize _size, Value _val, Value _ptr, uint64_t _ofs);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  MSize get_size() const;
+  const Value& get_val() const;
+  const Value& get_ptr() const;
+  uint64_t get_ofs() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 
@@ -142,17 +221,21 @@ public:
 
 class StmtBop: public Stmt {
 private:
-  const BopKind bop_kind;
   const Value val1;
   const Value val2;
+  const BopKind bop_kind;
   const Size size;
-
-  uint64_t compute(uint64_t op1, uint64_t op2) const;
+  const BopKernel kernel;
 
 public:
   StmtBop(int _line, Reg _lhs, BopKind _bop_kind, Value _val1, Value _val2, Size size);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  BopKind get_bop_kind() const;
+  const Value& get_val1() const;
+  const Value& get_val2() const;
+  Size get_size() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 
@@ -162,13 +245,16 @@ class StmtSum: public Stmt {
 public:
   const static int num_operands = 8;
 private:
-  vector<Value> values;
+  const ArenaArray<Value> values;
   const Size size;
 
 public:
-  StmtSum(int _line, Reg _lhs, const vector<Value>& _values, Size _size);
+  StmtSum(int _line, Reg _lhs, ArenaArray<Value> _values, Size _size);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  const ArenaArray<Value>& get_values() const;
+  Size get_size() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 
@@ -176,14 +262,19 @@ public:
 
 class StmtUop: public Stmt {
 private:
-  const UopKind uop_kind;
   const Value val;
+  const UopKind uop_kind;
   const Size size;
+  const UopKernel kernel;
 
 public:
   StmtUop(int _line, Reg _lhs, UopKind _uop_kind, Value _val, Size _size);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  UopKind get_uop_kind() const;
+  const Value& get_val() const;
+  Size get_size() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 
@@ -198,7 +289,11 @@ private:
 public:
   StmtSelect(int _line, Reg _lhs, Value _cond, Value _val_true, Value _val_false);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  const Value& get_cond() const;
+  const Value& get_val_true() const;
+  const Value& get_val_false() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 
@@ -206,17 +301,25 @@ public:
 
 class StmtCall: public Stmt {
 private:
-  const string fname;
-  vector<Value> args;
+  const string_view fname;
+  const ArenaArray<Value> args;
+  RegMask arg_regs = 0;
+  Function* callee = nullptr;
 
 public:
-  StmtCall(int _line, Reg _lhs, string _fname);
-
-  string get_fname() const;
-  void push_arg(Value arg);
-  int get_nargs();
-  double setup_args(double cost_acc, RegFile& old, RegFile& regfile);
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  StmtCall(int _line, Reg _lhs, string_view _fname, ArenaArray<Value> _args);
+
+  string_view get_fname() const;
+  Function* get_callee() const;
+  const ArenaArray<Value>& get_args() const;
+  int get_nargs() const;
+  RegMask get_arg_regs() const;
+  RegMask get_saved_regs() const;
+  double setup_args(double cost_acc, RegFile& regfile) const;
+  void resolve(Function* _callee);
+  void link(const Function& function, const Program& program) override;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 
@@ -230,7 +333,10 @@ private:
 public:
   StmtAssert(int _line, Value _op1, Value _op2);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  const Value& get_op1() const;
+  const Value& get_op2() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 
@@ -240,7 +346,7 @@ class StmtRead: public Stmt {
 public:
   StmtRead(int _line, Reg _lhs);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 class StmtWrite: public Stmt {
@@ -250,7 +356,9 @@ private:
 public:
   StmtWrite(int _line, Reg _lhs, Value _val);
 
-  pair<double, double> exec(double cost_acc, RegFile& regfile, Memory& memory) const override;
+  const Value& get_val() const;
+  RegMask get_clobbered_regs() const override;
+  pair<double, double> exec(double cost_acc, const Machine& machine, RegFile& regfile, Memory& memory, GuestIO& io) const override;
 };
 
 #endif //SWPP_ASM_INTERPRETER_STMT_H
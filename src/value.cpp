@@ -5,9 +5,28 @@ Value::Value(Reg _reg): kind(true), reg(_reg), literal(0) {}
 
 Value::Value(uint64_t _literal): kind(false), reg(RegNone), literal(_literal) {}
 
+bool Value::is_reg() const { return kind; }
+
+Reg Value::get_reg() const { return reg; }
+
+uint64_t Value::get_literal() const { return literal; }
+
 pair<uint64_t, double> Value::get_value(RegFile& regfile) const {
   if (kind)
     return regfile.read_reg(reg);
   else
     return make_pair(literal, -1.0);
-}
\ No newline at end of file
+}
+pair<uint64_t, double> Value::peek_value(const RegFile& regfile) const {
+  if (kind)
+    return regfile.peek_reg(reg);
+  else
+    return make_pair(literal, -1.0);
+}
+
+/** reading a writable register resolves its pending async load */
+RegMask Value::get_clobbered_regs() const {
+  if (kind && RegFile::is_writable(reg))
+    return reg_mask(reg);
+  return 0;
+}
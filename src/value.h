@@ -17,7 +17,12 @@ public:
   explicit Value(Reg _reg);
   explicit Value(uint64_t _literal);
 
+  bool is_reg() const;
+  Reg get_reg() const;
+  uint64_t get_literal() const;
   pair<uint64_t, double> get_value(RegFile& regfile) const;
+  pair<uint64_t, double> peek_value(const RegFile& regfile) const;
+  RegMask get_clobbered_regs() const;
 };
 
 #endif //SWPP_ASM_INTERPRETER_VALUE_H